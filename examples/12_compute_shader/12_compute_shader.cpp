@@ -3,26 +3,40 @@
 
 #include "VkBootstrap.h"
 
+#include <cstdio>
+#include <cstdlib>
 #include <ctime>
 #include <memory>
 #include <filesystem>
 
 int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    auto window = glfwCreateWindow(1024, 1024, "Example", nullptr, nullptr);
+    // IMR_HEADLESS=<frames> renders that many frames offscreen instead, for machines without a display
+    int headless_frames = getenv("IMR_HEADLESS") ? atoi(getenv("IMR_HEADLESS")) : 0;
 
-    imr::Context context;
+    GLFWwindow* window = nullptr;
+    std::unique_ptr<imr::Context> context_ptr;
+    if (headless_frames > 0) {
+        context_ptr = std::make_unique<imr::Context>(imr::Context::Headless{});
+    } else {
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(1024, 1024, "Example", nullptr, nullptr);
+        context_ptr = std::make_unique<imr::Context>();
+    }
+
+    imr::Context& context = *context_ptr;
     imr::Device device(context);
-    imr::Swapchain swapchain(device, window);
+    auto swapchain_ptr = window ? std::make_unique<imr::Swapchain>(device, window) : std::make_unique<imr::Swapchain>(device, imr::OffscreenTarget { .size = { 1024, 1024 } });
+    imr::Swapchain& swapchain = *swapchain_ptr;
     imr::FpsCounter fps_counter;
     // this class takes care of various boilerplate setup for you
     imr::ComputePipeline shader(device, "12_compute_shader.spv");
 
     auto& vk = device.dispatch;
-    while (!glfwWindowShouldClose(window)) {
+    for (int frame = 0; window ? !glfwWindowShouldClose(window) : frame < headless_frames; frame++) {
         fps_counter.tick();
-        fps_counter.updateGlfwWindowTitle(window);
+        if (window)
+            fps_counter.updateGlfwWindowTitle(window);
 
         swapchain.renderFrameSimplified([&](imr::Swapchain::SimplifiedRenderContext& context) {
             auto& image = context.image();
@@ -38,17 +52,20 @@ int main() {
 
             // We dispatch invocations in "workgroups", whose size is defined in the compute shader file
             // we need to dispatch (screenSize / workgroupSize) workgroups, but rounding up if the screen size is not a multiple of the workgroup size
-            // all sizes here are 3D but we use only the first two to match the screen size and make the "depth" dimension just one
-            vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+            // the pipeline knows its workgroup size, so it can do that math for us (the image is 2D, so its "depth" is just one)
+            shader.dispatch_for_extent(cmdbuf, image.size());
 
             context.addCleanupAction([=, &device]() {
                 delete shader_bind_helper;
             });
         });
 
-        glfwPollEvents();
+        if (window)
+            glfwPollEvents();
     }
 
     swapchain.drain();
+    if (!window)
+        printf("rendered %d frames offscreen, %d fps on average\n", headless_frames, fps_counter.average_fps());
     return 0;
 }
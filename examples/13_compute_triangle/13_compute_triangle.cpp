@@ -29,6 +29,7 @@ int main() {
     imr::Device device(context);
     imr::Swapchain swapchain(device, window);
     imr::FpsCounter fps_counter;
+    imr::mount_spirv_archive("13_compute_triangle.spvpak");
     imr::ComputePipeline shader(device, "13_compute_triangle.spv");
 
     auto& vk = device.dispatch;
@@ -76,7 +77,7 @@ int main() {
             vkCmdPushConstants(cmdbuf, shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
 
             // dispatch like before
-            vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+            shader.dispatch_for_extent(cmdbuf, image.size());
             context.addCleanupAction([=, &device]() {
                 delete shader_bind_helper;
             });
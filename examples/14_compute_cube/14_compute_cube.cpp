@@ -131,11 +131,6 @@ int main() {
                 })
             }));
 
-            vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.pipeline());
-            auto shader_bind_helper = shader.create_bind_helper();
-            shader_bind_helper->set_storage_image(0, 0, image.whole_image_view());
-            shader_bind_helper->commit(cmdbuf);
-
             // update the push constant data on the host...
             mat4 m = identity_mat4;
             mat4 flip_y = identity_mat4;
@@ -163,18 +158,12 @@ int main() {
 
                 push_constants.tri = transformed;
                 push_constants.time = ((imr_get_time_nano() / 1000) % 10000000000) / 1000000.0f;
-                // copy it to the command buffer!
-                vkCmdPushConstants(cmdbuf, shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
-
-                // dispatch like before
-                vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+                // launch() does everything the previous examples spelled out: bind the pipeline and the image, copy the push constants and dispatch.
+                // It keeps the descriptor set around, so the 11 other dispatches (and the next frames) reuse it instead of making their own.
+                shader.launch(cmdbuf, shader.groups_for_extent(image.size()), push_constants, imr::bind::storage_image(0, 0, image.whole_image_view()));
 
                 // EXERCISE: are we missing something here ?
             }
-
-            context.addCleanupAction([=, &device]() {
-                delete shader_bind_helper;
-            });
         });
 
         glfwPollEvents();
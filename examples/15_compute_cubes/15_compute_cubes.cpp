@@ -2,6 +2,7 @@
 #include "imr/util.h"
 
 #include <cmath>
+#include <thread>
 #include "nasl/nasl.h"
 #include "nasl/nasl_mat.h"
 
@@ -112,7 +113,6 @@ struct {
 
 struct {
     VkDeviceAddress preprocessed_tri_buffer;
-    uint32_t tri_count;
 } push_constants_pipelined_frag;
 
 Camera camera;
@@ -124,7 +124,16 @@ CameraInput camera_input;
 
 void camera_update(GLFWwindow*, CameraInput* input);
 
-bool reload_shaders = false;
+mat4 camera_matrix(uint32_t width, uint32_t height) {
+    mat4 m = identity_mat4;
+    mat4 flip_y = identity_mat4;
+    flip_y.rows[1][1] = -1;
+    m = m * flip_y;
+    mat4 view_mat = camera_get_view_mat4(&camera, width, height);
+    m = m * view_mat;
+    m = m * translate_mat4(vec3(-0.5, -0.5f, -0.5f));
+    return m;
+}
 
 #define INSTANCES_COUNT 16
 
@@ -146,23 +155,199 @@ struct PreprocessedTri {
 };
 
 TriDrawMode mode = SINGLE;
+/// SINGLE mode only: how many threads record the dispatches, each into its own secondary command buffer
+int recording_threads = 1;
+
+/// What the kernels get as specialization constants 0 to 2, only the ones the current mode uses are tuned
+struct WorkgroupSizes {
+    VkExtent3D single = { 32, 32, 1 };
+    VkExtent3D batched = { 32, 32, 1 };
+    VkExtent3D instanced = { 32, 32, 1 };
+    VkExtent3D pipelined_triangles = { 32, 32, 1 };
+    VkExtent3D pipelined_raster = { 32, 32, 1 };
+};
+
+static imr::SpecializationConstants workgroup_size(VkExtent3D size) {
+    return imr::SpecializationConstants().set<uint32_t>(0, size.width).set<uint32_t>(1, size.height).set<uint32_t>(2, size.depth);
+}
 
 struct Shaders {
-    imr::ComputePipeline single;
-    imr::ComputePipeline batched;
-    imr::ComputePipeline instanced;
-    imr::ComputePipeline pipelined_triangles;
-    imr::ComputePipeline pipelined_raster;
-
-    Shaders(imr::Device& d) :
-        single(d, "15_compute_cubes.spv"),
-        batched(d, "15_compute_cubes_batched.spv"),
-        instanced(d, "15_compute_cubes_instanced.spv"),
-        pipelined_triangles(d, "15_compute_cubes_pipelined_triangles.spv"),
-        pipelined_raster(d, "15_compute_cubes_pipelined_raster.spv")
+    // these all get built at once in the background, then again whenever their .spv file changes, without stalling the frames in flight
+    imr::PipelineHandle<imr::ComputePipeline> single;
+    imr::PipelineHandle<imr::ComputePipeline> batched;
+    imr::PipelineHandle<imr::ComputePipeline> instanced;
+    imr::PipelineHandle<imr::ComputePipeline> pipelined_triangles;
+    imr::PipelineHandle<imr::ComputePipeline> pipelined_raster;
+
+    Shaders(imr::Device& d, const WorkgroupSizes& sizes) :
+        single(d, "15_compute_cubes.spv", "main", workgroup_size(sizes.single)),
+        batched(d, "15_compute_cubes_batched.spv", "main", workgroup_size(sizes.batched)),
+        instanced(d, "15_compute_cubes_instanced.spv", "main", workgroup_size(sizes.instanced)),
+        pipelined_triangles(d, "15_compute_cubes_pipelined_triangles.spv", "main", workgroup_size(sizes.pipelined_triangles)),
+        pipelined_raster(d, "15_compute_cubes_pipelined_raster.spv", "main", workgroup_size(sizes.pipelined_raster).set<uint32_t>(3, INSTANCES_COUNT * 12))
         {}
+
+    void update() {
+        single.update();
+        batched.update();
+        instanced.update();
+        pipelined_triangles.update();
+        pipelined_raster.update();
+    }
 };
 
+/// Times the kernels the current mode uses on a window-sized frame seen from the starting camera.
+/// The tuner remembers the winners in the cache directory, so only the first run on a device pays for this.
+static WorkgroupSizes tune_workgroup_sizes(imr::Device& device, GLFWwindow* window, Cube& cube, std::vector<vec3>& positions, imr::Buffer* triangles_buffer, imr::Buffer* matrices_buffer, imr::Buffer* tmp_buffer) {
+    auto& vk = device.dispatch;
+    WorkgroupSizes sizes;
+
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    VkExtent3D screen = { (uint32_t) width, (uint32_t) height, 1 };
+    imr::Image target(device, VK_IMAGE_TYPE_2D, screen, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_STORAGE_BIT);
+    imr::Image depth(device, VK_IMAGE_TYPE_2D, screen, VK_FORMAT_R32_SFLOAT, static_cast<VkImageUsageFlagBits>(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT));
+    std::vector<imr::DescriptorBindHelper*> bind_helpers;
+
+    mat4 m = camera_matrix(screen.width, screen.height);
+    std::vector<mat4> matrices;
+    for (auto pos : positions)
+        matrices.push_back(m * translate_mat4(pos));
+    if (matrices_buffer)
+        matrices_buffer->uploadDataSync(0, sizeof(mat4) * matrices.size(), matrices.data());
+
+    auto add_compute_barrier = [&](VkCommandBuffer cmdbuf) {
+        vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = tmpPtr((VkMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .srcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+            })
+        }));
+    };
+
+    // each candidate starts from a cleared depth buffer, like a frame does
+    auto bind_targets = [&](VkCommandBuffer cmdbuf, imr::ComputePipeline& pipeline) {
+        VkImageMemoryBarrier2 barriers[2];
+        for (int i = 0; i < 2; i++) {
+            imr::Image& image = i == 0 ? target : depth;
+            barriers[i] = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+                .image = image.handle(),
+                .subresourceRange = image.whole_image_subresource_range(),
+            };
+        }
+        vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .imageMemoryBarrierCount = 2,
+            .pImageMemoryBarriers = barriers,
+        }));
+        vk.cmdClearColorImage(cmdbuf, depth.handle(), VK_IMAGE_LAYOUT_GENERAL, tmpPtr((VkClearColorValue) {
+            .float32 = { 1.0f, 0.0f, 0.0f, 0.0f },
+        }), 1, tmpPtr(depth.whole_image_subresource_range()));
+        vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = tmpPtr((VkMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            })
+        }));
+
+        auto shader_bind_helper = pipeline.create_bind_helper();
+        shader_bind_helper->set_storage_image(0, 0, target.whole_image_view());
+        shader_bind_helper->set_storage_image(0, 1, depth.whole_image_view());
+        shader_bind_helper->commit(cmdbuf);
+        bind_helpers.push_back(shader_bind_helper);
+    };
+
+    switch (mode) {
+        case SINGLE: {
+            auto push_constants = push_constants_single;
+            push_constants.tri = cube.triangles[0];
+            push_constants.matrix = matrices[0];
+            imr::WorkgroupSizeTuner tuner(device, "15_compute_cubes.spv");
+            sizes.single = tuner.tune(screen, [&](VkCommandBuffer cmdbuf, imr::ComputePipeline& pipeline) {
+                bind_targets(cmdbuf, pipeline);
+                vkCmdPushConstants(cmdbuf, pipeline.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+            }).local_size();
+            break;
+        }
+        case BATCHED: {
+            auto push_constants = push_constants_batched;
+            push_constants.tri_buffer = triangles_buffer->device_address();
+            push_constants.tri_count = 12;
+            push_constants.matrix = matrices[0];
+            imr::WorkgroupSizeTuner tuner(device, "15_compute_cubes_batched.spv");
+            sizes.batched = tuner.tune(screen, [&](VkCommandBuffer cmdbuf, imr::ComputePipeline& pipeline) {
+                bind_targets(cmdbuf, pipeline);
+                vkCmdPushConstants(cmdbuf, pipeline.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+            }).local_size();
+            break;
+        }
+        case INSTANCED: {
+            auto push_constants = push_constants_instanced;
+            push_constants.tri_buffer = triangles_buffer->device_address();
+            push_constants.tri_count = 12;
+            push_constants.matrices_buffer = matrices_buffer->device_address();
+            push_constants.instances_count = matrices.size();
+            imr::WorkgroupSizeTuner tuner(device, "15_compute_cubes_instanced.spv");
+            sizes.instanced = tuner.tune(screen, [&](VkCommandBuffer cmdbuf, imr::ComputePipeline& pipeline) {
+                bind_targets(cmdbuf, pipeline);
+                vkCmdPushConstants(cmdbuf, pipeline.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+            }).local_size();
+            break;
+        }
+        case PIPELINED: {
+            auto vert_push_constants = push_constants_pipelined_vert;
+            vert_push_constants.tri_buffer = triangles_buffer->device_address();
+            vert_push_constants.tri_count = 12;
+            vert_push_constants.matrices_buffer = matrices_buffer->device_address();
+            vert_push_constants.instances_count = matrices.size();
+            vert_push_constants.preprocessed_tri_buffer = tmp_buffer->device_address();
+            VkExtent3D triangles_extent = { 12, INSTANCES_COUNT, 1 };
+            imr::WorkgroupSizeTuner triangles_tuner(device, "15_compute_cubes_pipelined_triangles.spv");
+            auto& triangles_shader = triangles_tuner.tune(triangles_extent, [&](VkCommandBuffer cmdbuf, imr::ComputePipeline& pipeline) {
+                vkCmdPushConstants(cmdbuf, pipeline.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(vert_push_constants), &vert_push_constants);
+            });
+            sizes.pipelined_triangles = triangles_shader.local_size();
+
+            auto frag_push_constants = push_constants_pipelined_frag;
+            frag_push_constants.preprocessed_tri_buffer = tmp_buffer->device_address();
+            imr::WorkgroupSizeTuner raster_tuner(device, "15_compute_cubes_pipelined_raster.spv");
+            sizes.pipelined_raster = raster_tuner.tune(screen, [&](VkCommandBuffer cmdbuf, imr::ComputePipeline& pipeline) {
+                // give the rasterizer actual triangles to work on
+                vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, triangles_shader.pipeline());
+                vkCmdPushConstants(cmdbuf, triangles_shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(vert_push_constants), &vert_push_constants);
+                triangles_shader.dispatch_for_extent(cmdbuf, triangles_extent);
+                add_compute_barrier(cmdbuf);
+
+                vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline());
+                bind_targets(cmdbuf, pipeline);
+                vkCmdPushConstants(cmdbuf, pipeline.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(frag_push_constants), &frag_push_constants);
+            }, {}, imr::SpecializationConstants().set<uint32_t>(3, INSTANCES_COUNT * 12)).local_size();
+            break;
+        }
+    }
+
+    for (auto shader_bind_helper : bind_helpers)
+        delete shader_bind_helper;
+    return sizes;
+}
+
 int main(int argc, char** argv) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--batched") == 0) {
@@ -174,22 +359,19 @@ int main(int argc, char** argv) {
         if (strcmp(argv[i], "--pipelined") == 0) {
             mode = PIPELINED;
         }
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            recording_threads = std::max(1, atoi(argv[++i]));
+        }
     }
 
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     auto window = glfwCreateWindow(1024, 1024, "Example", nullptr, nullptr);
 
-    glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
-        if (key == GLFW_KEY_R && (mods & GLFW_MOD_CONTROL))
-            reload_shaders = true;
-    });
-
     imr::Context context;
     imr::Device device(context);
     imr::Swapchain swapchain(device, window);
     imr::FpsCounter fps_counter;
-    auto shaders = std::make_unique<Shaders>(device);
 
     auto cube = make_cube();
 
@@ -225,6 +407,8 @@ int main(int argc, char** argv) {
 
     camera = {{0, 0, 3}, {0, 0}, 60};
 
+    auto shaders = std::make_unique<Shaders>(device, tune_workgroup_sizes(device, window, cube, positions, triangles_buffer.get(), matrices_buffer.get(), tmp_buffer.get()));
+
     std::unique_ptr<imr::Image> depthBuffer;
 
     auto& vk = device.dispatch;
@@ -236,11 +420,7 @@ int main(int argc, char** argv) {
             camera_update(window, &camera_input);
             camera_move_freelook(&camera, &camera_input, &camera_state, delta);
 
-            if (reload_shaders) {
-                swapchain.drain();
-                shaders = std::make_unique<Shaders>(device);
-                reload_shaders = false;
-            }
+            shaders->update();
 
             auto& image = context.image();
             auto cmdbuf = context.cmdbuf();
@@ -291,7 +471,7 @@ int main(int argc, char** argv) {
                 })
             }));
 
-            auto add_render_barrier = [&]() {
+            auto add_render_barrier = [&](VkCommandBuffer cmdbuf) {
                 vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
                    .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
                    .dependencyFlags = 0,
@@ -307,51 +487,80 @@ int main(int argc, char** argv) {
             };
 
             // update the push constant data on the host...
-            mat4 m = identity_mat4;
-            mat4 flip_y = identity_mat4;
-            flip_y.rows[1][1] = -1;
-            m = m * flip_y;
-            mat4 view_mat = camera_get_view_mat4(&camera, context.image().size().width, context.image().size().height);
-            m = m * view_mat;
-            m = m * translate_mat4(vec3(-0.5, -0.5f, -0.5f));
+            mat4 m = camera_matrix(context.image().size().width, context.image().size().height);
 
             switch (mode) {
                 case SINGLE: {
-                    auto& shader = shaders->single;
-                    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.pipeline());
-                    auto shader_bind_helper = shader.create_bind_helper();
-                    shader_bind_helper->set_storage_image(0, 0, image.whole_image_view());
-                    shader_bind_helper->set_storage_image(0, 1, depthBuffer->whole_image_view());
-                    shader_bind_helper->commit(cmdbuf);
-
+                    auto& shader = *shaders->single;
                     push_constants_single.time = ((imr_get_time_nano() / 1000) % 10000000000) / 1000000.0f;
 
-                    for (auto pos : positions) {
-                        mat4 cube_matrix = m;
-                        cube_matrix = cube_matrix * translate_mat4(pos);
+                    // records the cubes in [begin, end), pipeline state isn't inherited by secondary command buffers so each one binds its own
+                    auto record_cubes = [&](VkCommandBuffer cmdbuf, size_t begin, size_t end) -> imr::DescriptorBindHelper* {
+                        vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.pipeline());
+                        auto shader_bind_helper = shader.create_bind_helper();
+                        shader_bind_helper->set_storage_image(0, 0, image.whole_image_view());
+                        shader_bind_helper->set_storage_image(0, 1, depthBuffer->whole_image_view());
+                        shader_bind_helper->commit(cmdbuf);
 
-                        for (int i = 0; i < 12; i++) {
-                            add_render_barrier();
+                        auto push_constants = push_constants_single;
+                        for (size_t cube_index = begin; cube_index < end; cube_index++) {
+                            mat4 cube_matrix = m;
+                            cube_matrix = cube_matrix * translate_mat4(positions[cube_index]);
 
-                            auto tri = cube.triangles[i];
+                            for (int i = 0; i < 12; i++) {
+                                add_render_barrier(cmdbuf);
 
-                            push_constants_single.tri = tri;
-                            push_constants_single.matrix = cube_matrix;
-                            // copy it to the command buffer!
-                            vkCmdPushConstants(cmdbuf, shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants_single), &push_constants_single);
+                                auto tri = cube.triangles[i];
 
-                            // dispatch like before
-                            vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+                                push_constants.tri = tri;
+                                push_constants.matrix = cube_matrix;
+                                // copy it to the command buffer!
+                                vkCmdPushConstants(cmdbuf, shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+
+                                // dispatch like before
+                                shader.dispatch_for_extent(cmdbuf, image.size());
+                            }
+                        }
+                        return shader_bind_helper;
+                    };
+
+                    // addCleanupAction isn't thread-safe, so the workers hand their helpers back to us
+                    std::vector<imr::DescriptorBindHelper*> bind_helpers(recording_threads);
+                    if (recording_threads == 1) {
+                        bind_helpers[0] = record_cubes(cmdbuf, 0, positions.size());
+                    } else {
+                        std::vector<VkCommandBuffer> secondaries(recording_threads);
+                        std::vector<std::thread> workers;
+                        for (int t = 0; t < recording_threads; t++) {
+                            workers.emplace_back([&, t]() {
+                                auto secondary = context.frame().allocateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+                                vkBeginCommandBuffer(secondary, tmpPtr((VkCommandBufferBeginInfo) {
+                                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                                    .pInheritanceInfo = tmpPtr((VkCommandBufferInheritanceInfo) {
+                                        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                                    }),
+                                }));
+                                size_t begin = positions.size() * t / recording_threads;
+                                size_t end = positions.size() * (t + 1) / recording_threads;
+                                bind_helpers[t] = record_cubes(secondary, begin, end);
+                                vkEndCommandBuffer(secondary);
+                                secondaries[t] = secondary;
+                            });
                         }
+                        for (auto& worker : workers)
+                            worker.join();
+                        vkCmdExecuteCommands(cmdbuf, secondaries.size(), secondaries.data());
                     }
 
-                    context.addCleanupAction([=, &device]() {
-                        delete shader_bind_helper;
+                    context.addCleanupAction([=]() {
+                        for (auto shader_bind_helper : bind_helpers)
+                            delete shader_bind_helper;
                     });
                     break;
                 }
                 case BATCHED: {
-                    auto& shader = shaders->batched;
+                    auto& shader = *shaders->batched;
                     vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.pipeline());
                     auto shader_bind_helper = shader.create_bind_helper();
                     shader_bind_helper->set_storage_image(0, 0, image.whole_image_view());
@@ -364,7 +573,7 @@ int main(int argc, char** argv) {
                     push_constants_batched.tri_count = 12;
 
                     for (auto pos : positions) {
-                        add_render_barrier();
+                        add_render_barrier(cmdbuf);
 
                         mat4 cube_matrix = m;
                         cube_matrix = cube_matrix * translate_mat4(pos);
@@ -372,13 +581,13 @@ int main(int argc, char** argv) {
                         push_constants_batched.matrix = cube_matrix;
 
                         vkCmdPushConstants(cmdbuf, shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants_batched), &push_constants_batched);
-                        vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+                        shader.dispatch_for_extent(cmdbuf, image.size());
                     }
 
                     break;
                 }
                 case INSTANCED: {
-                    auto& shader = shaders->instanced;
+                    auto& shader = *shaders->instanced;
                     vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.pipeline());
                     auto shader_bind_helper = shader.create_bind_helper();
                     shader_bind_helper->set_storage_image(0, 0, image.whole_image_view());
@@ -396,19 +605,19 @@ int main(int argc, char** argv) {
                         cube_matrix = cube_matrix * translate_mat4(pos);
                         matrices.push_back(cube_matrix);
                     }
-                    matrices_buffer->uploadDataSync(0, sizeof(mat4) * matrices.size(), matrices.data());
+                    matrices_buffer->uploadDataAsync(context, 0, std::as_bytes(std::span(matrices)));
 
                     push_constants_instanced.matrices_buffer = matrices_buffer->device_address();
                     push_constants_instanced.instances_count = matrices.size();
 
-                    add_render_barrier();
+                    add_render_barrier(cmdbuf);
 
                     vkCmdPushConstants(cmdbuf, shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants_instanced), &push_constants_instanced);
-                    vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+                    shader.dispatch_for_extent(cmdbuf, image.size());
                     break;
                 }
                 case PIPELINED: {
-                    auto& triangle_transform_shader = shaders->pipelined_triangles;
+                    auto& triangle_transform_shader = *shaders->pipelined_triangles;
                     vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, triangle_transform_shader.pipeline());
 
                     push_constants_pipelined_vert.time = ((imr_get_time_nano() / 1000) % 10000000000) / 1000000.0f;
@@ -422,20 +631,20 @@ int main(int argc, char** argv) {
                         cube_matrix = cube_matrix * translate_mat4(pos);
                         matrices.push_back(cube_matrix);
                     }
-                    matrices_buffer->uploadDataSync(0, sizeof(mat4) * matrices.size(), matrices.data());
+                    matrices_buffer->uploadDataAsync(context, 0, std::as_bytes(std::span(matrices)));
 
                     push_constants_pipelined_vert.matrices_buffer = matrices_buffer->device_address();
                     push_constants_pipelined_vert.instances_count = matrices.size();
                     push_constants_pipelined_vert.preprocessed_tri_buffer = tmp_buffer->device_address();
 
-                    add_render_barrier();
+                    add_render_barrier(cmdbuf);
 
                     vkCmdPushConstants(cmdbuf, triangle_transform_shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants_pipelined_vert), &push_constants_pipelined_vert);
-                    vkCmdDispatch(cmdbuf, (12 + 31) / 32, (INSTANCES_COUNT + 31) / 32, 1);
+                    triangle_transform_shader.dispatch_for_extent(cmdbuf, { 12, INSTANCES_COUNT, 1 });
 
-                    add_render_barrier();
+                    add_render_barrier(cmdbuf);
 
-                    auto& rasterizer_shader = shaders->pipelined_raster;
+                    auto& rasterizer_shader = *shaders->pipelined_raster;
                     vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, rasterizer_shader.pipeline());
                     auto shader_bind_helper = rasterizer_shader.create_bind_helper();
                     shader_bind_helper->set_storage_image(0, 0, image.whole_image_view());
@@ -443,11 +652,10 @@ int main(int argc, char** argv) {
                     shader_bind_helper->commit(cmdbuf);
 
                     push_constants_pipelined_frag.preprocessed_tri_buffer = tmp_buffer->device_address();
-                    push_constants_pipelined_frag.tri_count = INSTANCES_COUNT * 12;
 
                     vkCmdPushConstants(cmdbuf, rasterizer_shader.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants_pipelined_frag), &push_constants_pipelined_frag);
 
-                    vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+                    rasterizer_shader.dispatch_for_extent(cmdbuf, image.size());
                     break;
                 }
             }
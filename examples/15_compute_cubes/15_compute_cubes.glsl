@@ -8,7 +8,8 @@ uniform image2D renderTarget;
 layout(set = 0, binding = 1)
 uniform image2D depthBuffer;
 
-layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+// the application tunes the workgroup size (the same goes for the other kernels), this is only the default
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1, local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
 
 struct Tri { vec3 v0, v1, v2; vec3 color; };
 
@@ -9,7 +9,7 @@ uniform image2D renderTarget;
 layout(set = 0, binding = 1)
 uniform image2D depthBuffer;
 
-layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+layout(local_size_x = 32, local_size_y = 32, local_size_z = 1, local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
 
 struct Tri { vec3 v0, v1, v2; vec3 color; };
 
@@ -27,9 +27,11 @@ layout(scalar, buffer_reference) buffer PreprocessedTrianglesBuffer {
     PreprocessedTri triangles[192];
 };
 
+// set by the application, a constant trip count lets the compiler unroll the loop over the triangles
+layout(constant_id = 3) const uint TRIANGLES_COUNT = 192;
+
 layout(scalar, push_constant) uniform T {
     PreprocessedTrianglesBuffer preprocessed_triangles_buffer;
-    uint triangles_count;
 } push_constants;
 
 float cross_2(vec2 a, vec2 b) {
@@ -113,7 +115,7 @@ void main() {
     vec2 point = vec2(gl_GlobalInvocationID.xy) / vec2(img_size);
     point = point * 2.0 - vec2(1.0);
 
-    for (int i = 0; i < push_constants.triangles_count; i++) {
+    for (int i = 0; i < TRIANGLES_COUNT; i++) {
         drawTri(push_constants.preprocessed_triangles_buffer.triangles[i], point);
     }
 }
\ No newline at end of file
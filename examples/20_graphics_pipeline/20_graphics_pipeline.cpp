@@ -91,55 +91,56 @@ CameraInput camera_input;
 
 void camera_update(GLFWwindow*, CameraInput* input);
 
-bool reload_shaders = false;
-
 #define INSTANCES_COUNT 1024
 
-struct Shaders {
-    std::vector<std::string> files = { "20_graphics_pipeline.vert.spv", "20_graphics_pipeline.frag.spv" };
+static std::vector<std::string> shader_files = { "20_graphics_pipeline.vert.spv", "20_graphics_pipeline.frag.spv" };
+
+static std::unique_ptr<imr::GraphicsPipeline> build_pipeline(imr::Device& d, VkFormat format) {
+    imr::GraphicsPipeline::RenderTargetsState rts;
+    rts.color.push_back((imr::GraphicsPipeline::RenderTarget) {
+        .format = format,
+        .blending = {
+            .blendEnable = false,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+        }
+    });
+    imr::GraphicsPipeline::RenderTarget depth = {
+        .format = VK_FORMAT_D32_SFLOAT
+    };
+    rts.depth = depth;
+
+    imr::GraphicsPipeline::StateBuilder stateBuilder = {
+        .vertexInputState = imr::GraphicsPipeline::no_vertex_input(),
+        .inputAssemblyState = imr::GraphicsPipeline::simple_triangle_input_assembly(),
+        .viewportState = imr::GraphicsPipeline::one_dynamically_sized_viewport(),
+        .rasterizationState = imr::GraphicsPipeline::solid_filled_polygons(),
+        .multisampleState = imr::GraphicsPipeline::one_spp(),
+        .depthStencilState = imr::GraphicsPipeline::simple_depth_testing(),
+    };
 
     std::vector<std::unique_ptr<imr::ShaderModule>> modules;
     std::vector<std::unique_ptr<imr::ShaderEntryPoint>> entry_points;
-    std::unique_ptr<imr::GraphicsPipeline> pipeline;
-
-    Shaders(imr::Device& d, imr::Swapchain& swapchain) {
-        imr::GraphicsPipeline::RenderTargetsState rts;
-        rts.color.push_back((imr::GraphicsPipeline::RenderTarget) {
-            .format = swapchain.format(),
-            .blending = {
-                .blendEnable = false,
-                .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
-            }
-        });
-        imr::GraphicsPipeline::RenderTarget depth = {
-            .format = VK_FORMAT_D32_SFLOAT
-        };
-        rts.depth = depth;
-
-        imr::GraphicsPipeline::StateBuilder stateBuilder = {
-            .vertexInputState = imr::GraphicsPipeline::no_vertex_input(),
-            .inputAssemblyState = imr::GraphicsPipeline::simple_triangle_input_assembly(),
-            .viewportState = imr::GraphicsPipeline::one_dynamically_sized_viewport(),
-            .rasterizationState = imr::GraphicsPipeline::solid_filled_polygons(),
-            .multisampleState = imr::GraphicsPipeline::one_spp(),
-            .depthStencilState = imr::GraphicsPipeline::simple_depth_testing(),
-        };
-
-        std::vector<imr::ShaderEntryPoint*> entry_point_ptrs;
-        for (auto filename : files) {
-            VkShaderStageFlagBits stage;
-            if (filename.ends_with("vert.spv"))
-                stage = VK_SHADER_STAGE_VERTEX_BIT;
-            else if (filename.ends_with("frag.spv"))
-                stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-            else
-                throw std::runtime_error("Unknown suffix");
-            modules.push_back(std::make_unique<imr::ShaderModule>(d, std::move(filename)));
-            entry_points.push_back(std::make_unique<imr::ShaderEntryPoint>(*modules.back(), stage, "main"));
-            entry_point_ptrs.push_back(entry_points.back().get());
-        }
-        pipeline = std::make_unique<imr::GraphicsPipeline>(d, std::move(entry_point_ptrs), rts, stateBuilder);
+    std::vector<imr::ShaderEntryPoint*> entry_point_ptrs;
+    for (auto filename : shader_files) {
+        VkShaderStageFlagBits stage;
+        if (filename.ends_with("vert.spv"))
+            stage = VK_SHADER_STAGE_VERTEX_BIT;
+        else if (filename.ends_with("frag.spv"))
+            stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        else
+            throw std::runtime_error("Unknown suffix");
+        modules.push_back(std::make_unique<imr::ShaderModule>(d, std::move(filename)));
+        entry_points.push_back(std::make_unique<imr::ShaderEntryPoint>(*modules.back(), stage, "main"));
+        entry_point_ptrs.push_back(entry_points.back().get());
     }
+    return std::make_unique<imr::GraphicsPipeline>(d, std::move(entry_point_ptrs), rts, stateBuilder);
+}
+
+struct Shaders {
+    // rebuilt in the background whenever the .spv files change, without stalling the frames in flight
+    imr::PipelineHandle<imr::GraphicsPipeline> pipeline;
+
+    Shaders(imr::Device& d, imr::Swapchain& swapchain) : pipeline(d, shader_files, [format = swapchain.format()](imr::Device& d) { return build_pipeline(d, format); }) {}
 };
 
 int main(int argc, char** argv) {
@@ -147,11 +148,6 @@ int main(int argc, char** argv) {
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     auto window = glfwCreateWindow(1024, 1024, "Example", nullptr, nullptr);
 
-    glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
-        if (key == GLFW_KEY_R && (mods & GLFW_MOD_CONTROL))
-            reload_shaders = true;
-    });
-
     imr::Context context;
     imr::Device device(context);
     imr::Swapchain swapchain(device, window);
@@ -206,11 +202,7 @@ int main(int argc, char** argv) {
             camera_update(window, &camera_input);
             camera_move_freelook(&camera, &camera_input, &camera_state, delta);
 
-            if (reload_shaders) {
-                swapchain.drain();
-                shaders = std::make_unique<Shaders>(device, swapchain);
-                reload_shaders = false;
-            }
+            shaders->pipeline.update();
 
             auto& image = context.image();
             auto cmdbuf = context.cmdbuf();
@@ -349,8 +349,8 @@ int main() {
 
             // We dispatch invocations in "workgroups", whose size is defined in the compute shader file
             // we need to dispatch (screenSize / workgroupSize) workgroups, but rounding up if the screen size is not a multiple of the workgroup size
-            // all sizes here are 3D but we use only the first two to match the screen size and make the "depth" dimension just one
-            vkCmdDispatch(cmdbuf, (image.size().width + 31) / 32, (image.size().height + 31) / 32, 1);
+            // the pipeline knows its workgroup size, so it can do that math for us (the image is 2D, so its "depth" is just one)
+            shader.dispatch_for_extent(cmdbuf, image.size());
 
             context.addCleanupAction([=, &device]() {
                 delete shader_bind_helper;
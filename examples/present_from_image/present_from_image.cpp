@@ -144,7 +144,7 @@ int main() {
             vk.cmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.pipeline());
             vk.cmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, shader.layout(), 0, 1, &set, 0, nullptr);
 
-            vk.cmdDispatch(cmdbuf, (image->size().width + 31) / 32, (image->size().height + 31) / 32, 1);
+            shader.dispatch_for_extent(cmdbuf, image->size());
 
             vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr((VkDependencyInfo) {
                 .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
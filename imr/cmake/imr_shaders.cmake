@@ -0,0 +1,104 @@
+find_program(SPIRV_OPT_EXE spirv-opt)
+set(IMR_SHADER_OPTIMIZATION PERFORMANCE CACHE STRING "How imr_add_shader() optimizes SPIR-V unless told otherwise: PERFORMANCE (spirv-opt -O), SIZE (-Os) or NONE")
+set_property(CACHE IMR_SHADER_OPTIMIZATION PROPERTY STRINGS PERFORMANCE SIZE NONE)
+
+# Compiles a GLSL shader to SPIR-V next to the target, it's only rebuilt when the source or something it includes changes.
+#   imr_add_shader(<target> <source> [STAGE <stage>] [OUTPUT <name.spv>] [OPTIMIZE PERFORMANCE|SIZE|NONE] [TARGET_ENV <env>])
+# STAGE is needed for .glsl files, other extensions (.comp, .vert, .rgen...) tell glslang the stage. The output defaults to <source>.spv, or <name>.spv for <name>.glsl.
+# Release builds (Release, MinSizeRel) leave out debug information.
+function(imr_add_shader target source)
+    cmake_parse_arguments(PARSE_ARGV 2 SHADER "" "STAGE;OUTPUT;OPTIMIZE;TARGET_ENV" "")
+    cmake_path(ABSOLUTE_PATH source BASE_DIRECTORY ${CMAKE_CURRENT_SOURCE_DIR})
+    cmake_path(GET source FILENAME name)
+    if (NOT SHADER_OUTPUT)
+        cmake_path(GET source EXTENSION LAST_ONLY extension)
+        if (extension STREQUAL ".glsl")
+            cmake_path(GET source STEM LAST_ONLY name)
+        endif ()
+        set(SHADER_OUTPUT ${name}.spv)
+    endif ()
+    cmake_path(ABSOLUTE_PATH SHADER_OUTPUT BASE_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR} OUTPUT_VARIABLE output)
+    if (NOT SHADER_OPTIMIZE)
+        set(SHADER_OPTIMIZE ${IMR_SHADER_OPTIMIZATION})
+    endif ()
+
+    set(glslang_args -V $<$<CONFIG:Release,MinSizeRel>:-g0> --depfile ${output}.d)
+    if (SHADER_STAGE)
+        list(APPEND glslang_args -S ${SHADER_STAGE})
+    endif ()
+    if (SHADER_TARGET_ENV)
+        list(APPEND glslang_args --target-env ${SHADER_TARGET_ENV})
+        set(opt_args --target-env=${SHADER_TARGET_ENV})
+    endif ()
+
+    if (SHADER_OPTIMIZE STREQUAL "PERFORMANCE")
+        list(APPEND opt_args -O)
+    elseif (SHADER_OPTIMIZE STREQUAL "SIZE")
+        list(APPEND opt_args -Os)
+    elseif (NOT SHADER_OPTIMIZE STREQUAL "NONE")
+        message(FATAL_ERROR "imr_add_shader: OPTIMIZE must be PERFORMANCE, SIZE or NONE, not ${SHADER_OPTIMIZE}")
+    endif ()
+    set(optimize ${SHADER_OPTIMIZE})
+    if (NOT optimize STREQUAL "NONE" AND NOT SPIRV_OPT_EXE)
+        message(WARNING "spirv-opt wasn't found, ${name} won't be optimized")
+        set(optimize NONE)
+    endif ()
+
+    if (NOT optimize STREQUAL "NONE")
+        add_custom_command(OUTPUT ${output}
+                COMMAND ${GLSLANG_EXE} ${glslang_args} ${source} -o ${output}
+                COMMAND ${SPIRV_OPT_EXE} ${opt_args} ${output} -o ${output}
+                DEPENDS ${source}
+                DEPFILE ${output}.d
+                COMMAND_EXPAND_LISTS
+                COMMENT "Compiling ${name}"
+                VERBATIM)
+    else ()
+        add_custom_command(OUTPUT ${output}
+                COMMAND ${GLSLANG_EXE} ${glslang_args} ${source} -o ${output}
+                DEPENDS ${source}
+                DEPFILE ${output}.d
+                COMMAND_EXPAND_LISTS
+                COMMENT "Compiling ${name}"
+                VERBATIM)
+    endif ()
+    # not compiled, but building the target now produces it
+    target_sources(${target} PRIVATE ${output})
+endfunction()
+
+# Ship a target's SPIR-V without loading every module from its own file at startup, modules are registered under their filename.
+#   imr_embed_spirv(<target> <module.spv>...) compiles the modules into the target itself
+#   imr_pack_spirv(<target> <archive> <module.spv>...) packs them into one file next to the target, load it with imr::mount_spirv_archive()
+# Registered modules take precedence over files on disk, so don't embed shaders you want to hot reload.
+# Modules have to exist already or be built in the same directory, by imr_add_shader() or as the OUTPUT or BYPRODUCTS of a custom command or target:
+# a file nothing declares is missing from a clean build, and generators like Ninja refuse to guess where it comes from.
+
+function(_imr_check_spirv_modules caller)
+    foreach (module ${ARGN})
+        get_source_file_property(generated ${module} GENERATED)
+        if (NOT generated AND NOT EXISTS ${module})
+            message(FATAL_ERROR "${caller}: nothing builds ${module}, compile it with imr_add_shader() first or list it as an OUTPUT/BYPRODUCTS of whatever does")
+        endif ()
+    endforeach ()
+endfunction()
+
+function(imr_embed_spirv target)
+    _imr_check_spirv_modules(imr_embed_spirv ${ARGN})
+    set(output ${CMAKE_CURRENT_BINARY_DIR}/${target}_spirv.cpp)
+    add_custom_command(OUTPUT ${output}
+            COMMAND imr_spirv_pack embed ${output} ${ARGN}
+            DEPENDS imr_spirv_pack ${ARGN}
+            VERBATIM)
+    target_sources(${target} PRIVATE ${output})
+endfunction()
+
+function(imr_pack_spirv target archive)
+    _imr_check_spirv_modules(imr_pack_spirv ${ARGN})
+    set(output ${CMAKE_CURRENT_BINARY_DIR}/${archive})
+    add_custom_command(OUTPUT ${output}
+            COMMAND imr_spirv_pack archive ${output} ${ARGN}
+            DEPENDS imr_spirv_pack ${ARGN}
+            VERBATIM)
+    add_custom_target(${target}_${archive} DEPENDS ${output})
+    add_dependencies(${target} ${target}_${archive})
+endfunction()
@@ -5,9 +5,13 @@
 #include "GLFW/glfw3.h"
 #include "VkBootstrap.h"
 
+#include <array>
 #include <functional>
+#include <future>
 #include <memory>
 #include <optional>
+#include <span>
+#include <type_traits>
 
 #include <cstdio>
 
@@ -20,16 +24,23 @@ inline T* tmpPtr(T&& t) { return &t; }
 
 namespace imr {
 
+struct Image;
 struct Swapchain;
 struct AccelerationStructure;
 
 struct Context {
     Context(std::function<void(vkb::InstanceBuilder&)>&& instance_custom = [](auto&) {});
+    /// Tag for surfaceless contexts, for machines without a display: only offscreen Swapchains work on them
+    struct Headless {};
+    Context(Headless, std::function<void(vkb::InstanceBuilder&)>&& instance_custom = [](auto&) {});
     Context(Context&) = delete;
     ~Context();
 
     vkb::Instance instance;
     vkb::InstanceDispatchTable dispatch;
+    bool headless = false;
+    /// Enabled when available, VK_EXT_swapchain_maintenance1 depends on it
+    bool surface_maintenance1 = false;
 
     std::vector<vkb::PhysicalDevice> available_devices(std::function<void(vkb::PhysicalDeviceSelector&)>&& device_custom = [](auto&) {});
 };
@@ -48,12 +59,163 @@ struct Device {
     VkQueue main_queue;
     uint32_t main_queue_idx;
 
+    /// Optional extensions (and their features) that are enabled because the device supports them.
+    /// Check these to pick a fast path, everything keeps working without them.
+    struct Capabilities {
+        bool descriptor_buffer = false;
+        bool push_descriptor = false;
+        bool mesh_shader = false;
+        bool memory_budget = false;
+        bool host_image_copy = false;
+        bool present_wait = false;
+        bool swapchain_maintenance1 = false;
+        /// GraphicsPipelines asking for StateBuilder::fastLink are then linked from parts shared between pipelines, instead of being compiled as a whole
+        bool graphics_pipeline_library = false;
+        /// Extended dynamic state 1 and 2, core on Vulkan 1.3 devices
+        bool extended_dynamic_state = false;
+        /// Just the blend enable, blend equation, color write mask and polygon mode parts of it
+        bool extended_dynamic_state3 = false;
+        /// Compute pipelines can ask for a subgroup size and for full subgroups, see SubgroupSizeControl
+        bool subgroup_size_control = false;
+        /// What shaders get unless they ask for something else
+        uint32_t subgroup_size = 0;
+        /// The sizes subgroup_size_control can pick from, 0 without it
+        uint32_t min_subgroup_size = 0;
+        uint32_t max_subgroup_size = 0;
+    };
+    Capabilities capabilities;
+
+    /// Command pool of the thread that created the device, for the main queue
     VkCommandPool pool;
 
     vkb::DispatchTable dispatch;
 
+    /// Command pools are externally synchronized, so every thread that records commands needs its own.
+    /// Returns the calling thread's pool for `queue_family`, creating it on first use. Only use it from that thread!
+    /// The pool is reset and recycled when the thread exits, by then nothing recorded from it may still be pending.
+    VkCommandPool threadCommandPool(uint32_t queue_family);
+    VkCommandPool threadCommandPool();
+
+    /// Every pipeline imr creates goes through this cache. It's loaded from a file keyed by the device and driver version when the device is created, and saved back when it's destroyed.
+    /// The directory is $IMR_CACHE_DIR, or the user's cache directory
+    VkPipelineCache pipelineCache() const;
+    void savePipelineCache();
+    /// Counted from pipeline creation feedback, pipelines the driver gives no feedback for are not counted
+    struct PipelineCacheStats {
+        uint32_t hits;
+        uint32_t misses;
+    };
+    PipelineCacheStats pipelineCacheStats() const;
+
+    /// Can be called from any thread
     void executeCommandsSync(std::function<void(VkCommandBuffer)>);
 
+    struct Job;
+    /// Like executeCommandsSync, but doesn't block. The commands are recorded right away into a batch shared with other jobs,
+    /// which gets submitted once it's big enough, when a job in it is waited on, by flushJobs(), or before the next submit().
+    /// Jobs run in the order they were recorded in, with a full memory barrier between them. The lambda must not submit anything itself.
+    Job executeCommandsAsync(std::function<void(VkCommandBuffer)>);
+    /// Submits the batch being recorded, if any. Returns the ticket of the last batch submitted (0 if there never was one)
+    uint64_t flushJobs();
+    /// Retires finished jobs and runs their completion callbacks, Swapchain::beginFrame() does this for you
+    void pollJobs();
+
+    /// Submits to the main queue and signals the device-wide timeline semaphore.
+    /// Returns a ticket (the timeline value it signals) that can be waited on, polled, or turned into a GPU-side dependency with dependency()
+    uint64_t submit(std::vector<VkCommandBuffer> cmdbufs, std::vector<VkSemaphoreSubmitInfo> wait = {}, std::vector<VkSemaphoreSubmitInfo> signal = {}, VkFence fence = VK_NULL_HANDLE);
+    /// Blocks until the submission that returned `ticket` (and everything submitted before it) has completed
+    void wait(uint64_t ticket);
+    bool is_done(uint64_t ticket);
+    /// Wait info to pass to a later submit() so it waits on `ticket` on the GPU instead of the CPU
+    VkSemaphoreSubmitInfo dependency(uint64_t ticket, VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+    class Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+/// Completion handle returned by Device::executeCommandsAsync, cheap to copy
+struct Device::Job {
+    /// Submits the job's batch if that didn't happen yet. The ticket works like any other, e.g. with Device::dependency()
+    uint64_t ticket() const;
+    void wait() const;
+    bool is_done() const;
+    /// Runs `fn` once the job has completed: right away if it already has, otherwise from whichever of wait(), is_done() or Device::pollJobs() notices first
+    const Job& then(std::function<void()> fn) const;
+
+    struct Impl;
+    std::shared_ptr<Impl> _impl;
+};
+
+/// Stands in for a window: frames are rendered into a ring of images owned by the swapchain and never presented
+struct OffscreenTarget {
+    VkExtent2D size;
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    uint32_t frames_in_flight = 2;
+};
+
+struct Swapchain {
+    Swapchain(Device&, GLFWwindow* window);
+    /// Same frame API, no window system needed. The acquire/present semaphores of its frames are VK_NULL_HANDLE
+    Swapchain(Device&, OffscreenTarget);
+    ~Swapchain();
+
+    Device& device() const;
+    VkFormat format() const;
+
+    /// Approximate FPS cap, avoids melting your GPU on a trivial scene
+    int maxFps = 999;
+
+    struct Frame {
+        void presentFromBuffer(VkBuffer buffer, VkFence signal_when_reusable, std::optional<VkSemaphore> sem);
+        void presentFromImage(VkImage image, VkFence signal_when_reusable, std::optional<VkSemaphore> sem, VkImageLayout src_layout = VK_IMAGE_LAYOUT_GENERAL, std::optional<VkExtent2D> image_size = std::nullopt);
+
+        size_t id;
+        Image& image() const;
+        VkSemaphore swapchain_image_available;
+        VkSemaphore signal_when_ready;
+        void queuePresent();
+
+        /// The cleanup actions will only run once the submission that returned `ticket` has completed
+        void addCleanupTicket(uint64_t ticket);
+        void addCleanupAction(std::function<void(void)>&& fn);
+
+        void withRenderTargets(VkCommandBuffer, std::vector<Image*> color_images, Image* depth, std::function<void()> f);
+
+        /// Allocates a command buffer from a pool private to both the calling thread and this frame, so the frame can be recorded from several threads at once.
+        /// The pools are reset wholesale when the frame retires, the command buffers don't need to be freed.
+        /// Unlike the rest of the Frame API, this is safe to call from any thread.
+        VkCommandBuffer allocateCommandBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        class Impl;
+        std::unique_ptr<Impl> _impl;
+
+        Frame(Impl&&);
+        Frame(Frame&) = delete;
+        ~Frame();
+    };
+
+    /// API to obtain a swapchain image, do some rendering with it and then ultimately queuePresent it.
+    /// You have to consume the `swapchain_image_available` semaphore
+    /// You have to signal the `signal_when_ready` semaphore
+    /// You have to call queuePresent() when you're done
+    void beginFrame(std::function<void(Swapchain::Frame&)>&& fn);
+
+    struct SimplifiedRenderContext {
+        virtual Image& image() const = 0;
+        virtual VkCommandBuffer cmdbuf() const = 0;
+        virtual Swapchain::Frame& frame() const = 0;
+
+        virtual void addCleanupAction(std::function<void(void)>&& fn) = 0;
+    };
+
+    /// Simplified API to draw a frame, deals with cmdbuf allocation, recording and submission, as well as layout transitions in and out of VK_IMAGE_LAYOUT_GENERAL for the swapchain image
+    void renderFrameSimplified(std::function<void(SimplifiedRenderContext&)>&& fn);
+
+    void resize();
+
+    /// Waits until all the in-flight frames are done and runs their cleanup jobs
+    void drain();
+
     class Impl;
     std::unique_ptr<Impl> _impl;
 };
@@ -72,6 +234,49 @@ struct Buffer {
     size_t memory_offset;
 
     void uploadDataSync(uint64_t offset, uint64_t size, void* data);
+    /// Stages the data in the device's persistently mapped staging ring and records the copy into `cmdbuf`, instead of submitting and waiting.
+    /// The staging space is recycled once `frame` retires, which makes this the right tool for per-frame updates.
+    void uploadDataAsync(VkCommandBuffer cmdbuf, Swapchain::Frame& frame, uint64_t offset, std::span<const std::byte> data);
+    void uploadDataAsync(Swapchain::SimplifiedRenderContext& context, uint64_t offset, std::span<const std::byte> data);
+    /// For uploads outside of a frame, e.g. while loading a scene: the copy goes into the device's async job batch instead of being waited on.
+    Device::Job uploadDataAsync(uint64_t offset, std::span<const std::byte> data);
+    /// Host-visible buffers are read directly, others need VK_BUFFER_USAGE_TRANSFER_SRC_BIT to be copied through a staging buffer
+    void downloadDataSync(uint64_t offset, uint64_t size, void* data);
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+/// One Device per physical device, to spread work over all the GPUs of a machine
+struct DeviceGroup {
+    /// Creates a Device for every physical device the (customised) default selector accepts
+    DeviceGroup(Context&, std::function<void(vkb::PhysicalDeviceSelector&)>&& device_custom = [](auto&) {});
+    /// Creates a Device for every entry, the same physical device can appear more than once (handy for testing on a single GPU or lavapipe)
+    DeviceGroup(Context&, std::vector<vkb::PhysicalDevice>);
+    DeviceGroup(DeviceGroup&) = delete;
+    ~DeviceGroup();
+
+    std::vector<std::unique_ptr<Device>> devices;
+    size_t size() const;
+    Device& operator[](size_t i) const;
+
+    /// A contiguous share of the work, e.g. a range of instances or rows of tiles
+    struct Range {
+        uint32_t begin;
+        uint32_t end;
+        uint32_t count() const { return end - begin; }
+    };
+
+    /// Splits [0, count) into one range per device, proportionally to `weights` (evenly if empty)
+    std::vector<Range> split(uint32_t count, std::vector<float> weights = {}) const;
+
+    /// Records `record` for each device's share of [0, count) and runs them on all devices at the same time, each from the device's worker thread.
+    /// Blocks until every device is done.
+    void dispatchSplit(uint32_t count, std::function<void(size_t device_index, Device&, VkCommandBuffer, Range)> record, std::vector<float> weights = {});
+
+    /// Copies [offset, offset + size) from `src` to the same place in `dst`, the buffers may live on different devices in the group.
+    /// Goes through host memory, so `src` needs to be host-visible or have VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+    void gather(Buffer& src, Buffer& dst, uint64_t offset, uint64_t size);
 
     struct Impl;
     std::unique_ptr<Impl> _impl;
@@ -101,8 +306,41 @@ private:
     std::unique_ptr<Impl> _impl;
 };
 
+/// Makes SPIR-V that's already in memory loadable by filename, ShaderModule checks these before looking on disk.
+/// The data must stay valid for the rest of the program. Files embedded with imr_embed_spirv() in CMake register themselves.
+void register_spirv(std::string filename, std::span<const uint32_t> spirv);
+/// Maps an archive written by imr_pack_spirv() (found next to the executable, like the modules themselves) and registers every module in it.
+/// It stays mapped for the rest of the program, throws if it can't be read.
+void mount_spirv_archive(const std::string& filename);
+
 struct ShaderModule {
+    /// Uses the registered SPIR-V if there is some under that name, otherwise reads the file next to the executable
     ShaderModule(imr::Device& device, std::string&& filename) noexcept(false);
+    /// Only needs `spirv` during the call, and doesn't even copy it if an identical module exists already
+    ShaderModule(imr::Device& device, std::span<const uint32_t> spirv) noexcept(false);
+
+    /// A kernel to compile at runtime, see from_source()
+    struct Source {
+        enum Language {
+            /// Goes through shady's C frontend, vcc ($IMR_VCC, or vcc on the PATH)
+            C,
+            /// Goes through glslang ($IMR_GLSLANG, or glslang/glslangValidator on the PATH)
+            GLSL,
+        };
+
+        Language language;
+        std::string code;
+        /// GLSL needs to be told, C kernels declare it on their entry point
+        VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        /// Passed to the compiler as is (-D, -I...). Part of the cache key, unlike the contents of included files.
+        std::vector<std::string> compiler_args = {};
+    };
+
+    /// Compiles `source`, unless SPIR-V for the same code, language, stage, arguments and compiler version is in the cache directory already.
+    /// Throws if the compiler can't be run or fails, its diagnostics go to stderr.
+    static ShaderModule from_source(imr::Device& device, const Source& source) noexcept(false);
+    struct Impl;
+    explicit ShaderModule(std::unique_ptr<Impl>&&);
     ShaderModule(const ShaderModule&) = delete;
     ShaderModule(ShaderModule&&) = default;
 
@@ -110,17 +348,40 @@ struct ShaderModule {
 
     ~ShaderModule();
 
-    struct Impl;
     std::unique_ptr<Impl> _impl;
 };
 
+/// Values for a shader's specialization constants (`layout(constant_id = N) const ...`), by constant id
+struct SpecializationConstants {
+    template<typename T> requires std::is_trivially_copyable_v<T>
+    SpecializationConstants& set(uint32_t constant_id, T value) {
+        // SPIR-V booleans are 32 bits wide
+        if constexpr (std::is_same_v<T, bool>)
+            return set_bytes(constant_id, tmpPtr<VkBool32>(value ? VK_TRUE : VK_FALSE), sizeof(VkBool32));
+        else
+            return set_bytes(constant_id, &value, sizeof(T));
+    }
+    SpecializationConstants& set_bytes(uint32_t constant_id, const void* value, size_t size);
+
+    bool empty() const { return entries.empty(); }
+    /// Points into this object, so it stays valid as long as it's not modified
+    VkSpecializationInfo info() const;
+    /// Same constants and values give the same key, whatever order they were set in
+    std::vector<uint8_t> key() const;
+
+    /// Kept sorted by constant id
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+};
+
 struct ShaderEntryPoint {
-    ShaderEntryPoint(ShaderModule& module, VkShaderStageFlagBits stage, const std::string& entrypoint_name);
+    ShaderEntryPoint(ShaderModule& module, VkShaderStageFlagBits stage, const std::string& entrypoint_name, SpecializationConstants specialization = {});
     ~ShaderEntryPoint();
 
     VkShaderStageFlagBits stage() const;
     const std::string& name() const;
     const ShaderModule& module() const;
+    const SpecializationConstants& specialization() const;
 
     struct Impl;
     std::unique_ptr<Impl> _impl;
@@ -147,17 +408,118 @@ struct DescriptorBindHelper {
     std::unique_ptr<Impl> _impl;
 };
 
+/// Subgroup size control for compute pipelines, anything but the defaults needs Device::Capabilities::subgroup_size_control.
+/// Pipeline creation throws if the device can't do what's asked.
+struct SubgroupSizeControl {
+    /// 0 leaves it to the driver, otherwise a power of two between the device's min_subgroup_size and max_subgroup_size
+    uint32_t required_size = 0;
+    /// Only launch full subgroups, the workgroup's x size must then be a multiple of the subgroup size (of max_subgroup_size if no size is required)
+    bool full_subgroups = false;
+    /// Without a required size, lets the driver pick any size between min and max rather than the default one
+    bool allow_varying_size = false;
+};
+
+/// One resource for ComputePipeline::launch(), make them with the functions in imr::bind.
+/// Launches compare these by handle, so a resource destroyed behind imr's back (a view you made yourself, say) needs forget_launch_binding().
+struct LaunchBinding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t array_element = 0;
+    /// Whichever of these `type` takes, the others stay null
+    VkImageView image_view = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkAccelerationStructureKHR acceleration_structure = VK_NULL_HANDLE;
+    uint64_t offset = 0;
+    uint64_t range = 0;
+};
+
+/// Same arguments as the DescriptorBindHelper setters
+namespace bind {
+    LaunchBinding storage_image(uint32_t set, uint32_t binding, VkImageView, uint32_t array_element = 0);
+    LaunchBinding sampler(uint32_t set, uint32_t binding, VkSampler, uint32_t array_element = 0);
+    LaunchBinding texture_image(uint32_t set, uint32_t binding, VkImageView, uint32_t array_element = 0);
+    LaunchBinding uniform_buffer(uint32_t set, uint32_t binding, Buffer&, uint64_t offset = 0);
+    LaunchBinding storage_buffer(uint32_t set, uint32_t binding, Buffer&, uint64_t offset = 0);
+    LaunchBinding acceleration_structure(uint32_t set, uint32_t binding, AccelerationStructure&);
+}
+
+/// Drops the descriptor sets launches have cached for a handle that's about to be destroyed. imr does this itself for its Images, Buffers and AccelerationStructures.
+void forget_launch_binding(Device&, uint64_t handle);
+template<typename Handle> requires (!std::is_same_v<Handle, uint64_t>)
+void forget_launch_binding(Device& device, Handle handle) { forget_launch_binding(device, (uint64_t) handle); }
+
 struct ComputePipeline {
-    ComputePipeline(Device&, std::string&& spirv_filename, std::string&& entrypoint_name = "main");
+    ComputePipeline(Device&, std::string&& spirv_filename, std::string&& entrypoint_name = "main", SpecializationConstants specialization = {}, SubgroupSizeControl subgroup_size_control = {});
+    struct Impl;
+    explicit ComputePipeline(std::unique_ptr<Impl>&&);
     ComputePipeline(ComputePipeline&) = delete;
     ~ComputePipeline();
 
     VkPipeline pipeline() const;
     VkPipelineLayout layout() const;
     VkDescriptorSetLayout set_layout(unsigned) const;
+    /// The required size if there is one, otherwise the device's default. With allow_varying_size, that's merely the most likely one.
+    uint32_t subgroup_size() const;
+    /// The workgroup size, specialization included
+    VkExtent3D local_size() const;
+
+    /// Dispatches enough workgroups to cover `extent` invocations, the pipeline has to be bound already
+    void dispatch_for_extent(VkCommandBuffer, VkExtent3D extent) const;
+    /// How many workgroups dispatch_for_extent() dispatches
+    VkExtent3D groups_for_extent(VkExtent3D extent) const;
+
+    /// Binds the pipeline, the descriptor sets for `bindings` and the push constants, then dispatches `groups` workgroups.
+    /// `push_constants` has to be the shader's push constant block, its size is checked against reflection (throws on a mismatch).
+    /// The descriptor sets are written once and cached by the resources in them, so launching with the same ones again doesn't touch descriptors.
+    /// Sets are only freed once the commands using them have been submitted and have completed. Launches into secondary command buffers never are submitted themselves, their sets stay until the pipeline goes.
+    template<typename PushConstants, typename... Bindings> requires (!std::is_same_v<PushConstants, LaunchBinding> && (std::is_same_v<Bindings, LaunchBinding> && ...))
+    void launch(VkCommandBuffer cmdbuf, VkExtent3D groups, const PushConstants& push_constants, const Bindings&... bindings) {
+        static_assert(std::is_trivially_copyable_v<PushConstants>, "push constants are copied bytewise");
+        launch(cmdbuf, groups, &push_constants, sizeof(PushConstants), alignof(PushConstants), { bindings... });
+    }
+    /// For shaders without push constants
+    template<typename... Bindings> requires (std::is_same_v<Bindings, LaunchBinding> && ...)
+    void launch(VkCommandBuffer cmdbuf, VkExtent3D groups, const Bindings&... bindings) {
+        launch(cmdbuf, groups, nullptr, 0, 1, { bindings... });
+    }
+    void launch(VkCommandBuffer, VkExtent3D groups, const void* push_constants, size_t push_constants_size, size_t push_constants_alignment, std::initializer_list<LaunchBinding> bindings);
 
     DescriptorBindHelper* create_bind_helper();
 
+    std::unique_ptr<Impl> _impl;
+};
+
+/// Specialized versions of one compute shader, which share the shader module and its reflection.
+/// Each variant is built the first time it's asked for, and stays around as long as this does.
+struct ComputePipelineVariants {
+    ComputePipelineVariants(Device&, std::string spirv_filename, std::string entrypoint_name = "main");
+    ComputePipelineVariants(const ComputePipelineVariants&) = delete;
+    ~ComputePipelineVariants();
+
+    /// Thread-safe, the returned pipeline stays valid as long as this object
+    ComputePipeline& get(const SpecializationConstants&);
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+/// Picks the fastest workgroup size for a compute kernel that takes it from specialization constants, e.g. `layout(local_size_x_id = 0, local_size_y_id = 1) in;`.
+/// Candidates are timed with timestamp queries on a representative dispatch. The winner is remembered per kernel and device (by pipelineCacheUUID) in the cache directory, so each device only tunes once.
+struct WorkgroupSizeTuner {
+    WorkgroupSizeTuner(Device&, std::string spirv_filename, std::string entrypoint_name = "main", std::array<uint32_t, 3> size_constant_ids = { 0, 1, 2 });
+    WorkgroupSizeTuner(const WorkgroupSizeTuner&) = delete;
+    ~WorkgroupSizeTuner();
+
+    /// Binds whatever the kernel needs (descriptor sets, push constants) for the dispatch being timed, the pipeline is bound already
+    using Bind = std::function<void(VkCommandBuffer, ComputePipeline&)>;
+
+    /// Returns the pipeline with the fastest workgroup size for dispatches over `extent` invocations, it stays valid as long as this object.
+    /// The default candidates go from 32 to 1024 invocations, in 1D or 2D depending on `extent`, minus those the device doesn't allow.
+    /// If the device's main queue can't take timestamps nothing is timed and the first candidate wins. Blocks while timing, don't call it in the middle of a frame.
+    ComputePipeline& tune(VkExtent3D extent, const Bind& bind, std::vector<VkExtent3D> candidates = {}, const SpecializationConstants& specialization = {});
+
     struct Impl;
     std::unique_ptr<Impl> _impl;
 };
@@ -208,6 +570,46 @@ struct GraphicsPipeline {
         std::optional<VkPipelineRasterizationStateCreateInfo>    rasterizationState;
         std::optional<VkPipelineMultisampleStateCreateInfo>      multisampleState;
         std::optional<VkPipelineDepthStencilStateCreateInfo>     depthStencilState;
+        /// State to leave dynamic on top of the viewport and scissor, the corresponding values above are then ignored.
+        /// Most of these need Device::capabilities.extended_dynamic_state(3), pipeline creation throws if they're missing.
+        std::vector<VkDynamicState>                              dynamicStates;
+        /// With Device::capabilities.graphics_pipeline_library, link the pipeline from parts shared with other pipelines instead of compiling it whole.
+        /// Much quicker to create, but without link-time optimization it may run slower. Ignored on devices without the extension.
+        bool fastLink = false;
+    };
+
+    /// Cull mode, front face, topology and depth test/write/compare: enough for one pipeline to serve many materials
+    static std::vector<VkDynamicState> material_dynamic_states();
+    /// Blend enable, equation and color write mask (extended_dynamic_state3)
+    static std::vector<VkDynamicState> blend_dynamic_states();
+
+    /// Sets the state that a pipeline left dynamic, while recording. Only set states the bound pipeline actually declared dynamic.
+    struct DynamicStateRecorder {
+        DynamicStateRecorder(Device&, VkCommandBuffer);
+
+        DynamicStateRecorder& viewport(VkViewport);
+        DynamicStateRecorder& scissor(VkRect2D);
+
+        DynamicStateRecorder& cull_mode(VkCullModeFlags);
+        DynamicStateRecorder& front_face(VkFrontFace);
+        DynamicStateRecorder& primitive_topology(VkPrimitiveTopology);
+        DynamicStateRecorder& depth_test(bool enable);
+        DynamicStateRecorder& depth_write(bool enable);
+        DynamicStateRecorder& depth_compare_op(VkCompareOp);
+        DynamicStateRecorder& stencil_test(bool enable);
+        DynamicStateRecorder& stencil_op(VkStencilFaceFlags face_mask, VkStencilOp fail_op, VkStencilOp pass_op, VkStencilOp depth_fail_op, VkCompareOp compare_op);
+        DynamicStateRecorder& depth_bias(bool enable);
+        DynamicStateRecorder& primitive_restart(bool enable);
+        DynamicStateRecorder& rasterizer_discard(bool enable);
+
+        DynamicStateRecorder& polygon_mode(VkPolygonMode);
+        /// The remaining setters apply to the color attachments starting at `first_attachment`, one value each
+        DynamicStateRecorder& blend_enable(std::vector<VkBool32> enable, uint32_t first_attachment = 0);
+        DynamicStateRecorder& blend_equation(std::vector<VkColorBlendEquationEXT> equations, uint32_t first_attachment = 0);
+        DynamicStateRecorder& color_write_mask(std::vector<VkColorComponentFlags> masks, uint32_t first_attachment = 0);
+
+        Device& device;
+        VkCommandBuffer cmdbuf;
     };
 
     // These helpers contain sensible defaults for most pieces of state
@@ -232,6 +634,96 @@ struct GraphicsPipeline {
     std::unique_ptr<Impl> _impl;
 };
 
+/// Collects pipelines to create, then compiles them all at once on worker threads.
+/// The futures handed out by add_*() become ready as build() gets through them, errors are rethrown by get().
+struct PipelineBatch {
+    struct Stage {
+        std::string spirv_filename;
+        VkShaderStageFlagBits stage;
+        std::string entrypoint_name = "main";
+        SpecializationConstants specialization = {};
+    };
+
+    explicit PipelineBatch(Device&);
+    PipelineBatch(const PipelineBatch&) = delete;
+    /// Builds whatever was added since the last build()
+    ~PipelineBatch();
+
+    std::future<std::unique_ptr<ComputePipeline>> add_compute(std::string spirv_filename, std::string entrypoint_name = "main", SpecializationConstants specialization = {});
+    /// The shader modules are loaded on the worker too and don't outlive the pipeline's creation
+    std::future<std::unique_ptr<GraphicsPipeline>> add_graphics(std::vector<Stage> stages, GraphicsPipeline::RenderTargetsState, GraphicsPipeline::StateBuilder);
+
+    /// Anything else that's worth building off the main thread
+    template<typename T>
+    std::future<std::unique_ptr<T>> add(std::function<std::unique_ptr<T>(Device&)> fn) {
+        auto task = std::make_shared<std::packaged_task<std::unique_ptr<T>(Device&)>>(std::move(fn));
+        auto future = task->get_future();
+        tasks.push_back([task](Device& device) { (*task)(device); });
+        return future;
+    }
+
+    /// Blocks until every pipeline added so far is created, `threads` = 0 means one per hardware thread
+    void build(unsigned threads = 0);
+
+    Device& device;
+    std::vector<std::function<void(Device&)>> tasks;
+};
+
+/// Hands out the same pipeline for the same shaders and state, so renderers can ask for "the pipeline for this material" on the hot path.
+/// Requests are keyed by the shaders' SPIR-V, entry points and specialization, the render target formats and blending and all of the state.
+/// Extension structs aren't covered by the keys, graphics() throws if any of the state has a pNext chain.
+/// Only weak references are kept: a pipeline is destroyed along with the last shared_ptr to it.
+struct PipelineCache {
+    explicit PipelineCache(Device&);
+    PipelineCache(const PipelineCache&) = delete;
+    ~PipelineCache();
+
+    /// Thread-safe. The entry points only need to live during the call.
+    /// Pipelines are created outside the lock, two threads asking for the same new one at once may both build it.
+    std::shared_ptr<ComputePipeline> compute(ShaderEntryPoint&);
+    std::shared_ptr<GraphicsPipeline> graphics(const std::vector<ShaderEntryPoint*>& stages, const GraphicsPipeline::RenderTargetsState&, const GraphicsPipeline::StateBuilder&);
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+/// Builds a pipeline on a background thread, then builds it again whenever one of the SPIR-V files it's made from changes on disk.
+/// Untyped, use PipelineHandle instead.
+struct PipelineReloader {
+    PipelineReloader(Device&, std::vector<std::string> spirv_filenames, std::function<std::shared_ptr<void>(Device&)> build);
+    PipelineReloader(const PipelineReloader&) = delete;
+    /// Waits for the GPU to be done with the pipelines that were swapped out
+    ~PipelineReloader();
+
+    /// Blocks until the first build is done, rethrows if that failed
+    void* get() const;
+    /// Swaps in the latest rebuild, if any, and destroys the pipelines it replaced once the GPU is done with them
+    bool update();
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+/// A pipeline that follows its shaders on disk. Rebuilds happen off the render thread, the previous pipeline stays in use until they're done.
+/// Call update() between frames, before recording anything that uses the pipeline: get() only changes there.
+/// A rebuild that fails is reported on stderr and the previous pipeline is kept.
+template<typename Pipeline>
+struct PipelineHandle {
+    PipelineHandle(Device& device, std::vector<std::string> spirv_filenames, std::function<std::unique_ptr<Pipeline>(Device&)> build)
+        : reloader(device, std::move(spirv_filenames), [build = std::move(build)](Device& device) -> std::shared_ptr<void> { return build(device); }) {}
+
+    PipelineHandle(Device& device, std::string spirv_filename, std::string entrypoint_name = "main", SpecializationConstants specialization = {}) requires std::is_same_v<Pipeline, ComputePipeline>
+        : PipelineHandle(device, { spirv_filename }, [=](Device& device) { return std::make_unique<ComputePipeline>(device, std::string(spirv_filename), std::string(entrypoint_name), specialization); }) {}
+
+    Pipeline& get() const { return *static_cast<Pipeline*>(reloader.get()); }
+    Pipeline* operator->() const { return &get(); }
+    Pipeline& operator*() const { return get(); }
+
+    bool update() { return reloader.update(); }
+
+    PipelineReloader reloader;
+};
+
 // Ray tracing acceleration structure
 struct AccelerationStructure {
     AccelerationStructure(Device&);
@@ -249,6 +741,8 @@ struct AccelerationStructure {
         VkTransformMatrixKHR matrix;
     };
 
+    /// Builds are queued with Device::executeCommandsAsync, anything submitted afterwards sees the finished structure.
+    /// The geometry buffers must stay alive until the build has run, e.g. until the next frame or until Device::flushJobs()'s ticket.
     void createBottomLevelAccelerationStructure(std::vector<TriangleGeometry>);
     void createTopLevelAccelerationStructure(std::vector<std::tuple<VkTransformMatrixKHR, AccelerationStructure*>>& bottomLevelAS);
 
@@ -257,65 +751,6 @@ private:
     std::unique_ptr<Impl> _impl;
 };
 
-struct Swapchain {
-    Swapchain(Device&, GLFWwindow* window);
-    ~Swapchain();
-
-    Device& device() const;
-    VkFormat format() const;
-
-    /// Approximate FPS cap, avoids melting your GPU on a trivial scene
-    int maxFps = 999;
-
-    struct Frame {
-        void presentFromBuffer(VkBuffer buffer, VkFence signal_when_reusable, std::optional<VkSemaphore> sem);
-        void presentFromImage(VkImage image, VkFence signal_when_reusable, std::optional<VkSemaphore> sem, VkImageLayout src_layout = VK_IMAGE_LAYOUT_GENERAL, std::optional<VkExtent2D> image_size = std::nullopt);
-
-        size_t id;
-        Image& image() const;
-        VkSemaphore swapchain_image_available;
-        VkSemaphore signal_when_ready;
-        void queuePresent();
-
-        void addCleanupFence(VkFence fence);
-        void addCleanupAction(std::function<void(void)>&& fn);
-
-        void withRenderTargets(VkCommandBuffer, std::vector<Image*> color_images, Image* depth, std::function<void()> f);
-
-        class Impl;
-        std::unique_ptr<Impl> _impl;
-
-        Frame(Impl&&);
-        Frame(Frame&) = delete;
-        ~Frame();
-    };
-
-    /// API to obtain a swapchain image, do some rendering with it and then ultimately queuePresent it.
-    /// You have to consume the `swapchain_image_available` semaphore
-    /// You have to signal the `signal_when_ready` semaphore
-    /// You have to call queuePresent() when you're done
-    void beginFrame(std::function<void(Swapchain::Frame&)>&& fn);
-
-    struct SimplifiedRenderContext {
-        virtual Image& image() const = 0;
-        virtual VkCommandBuffer cmdbuf() const = 0;
-        virtual Swapchain::Frame& frame() const = 0;
-
-        virtual void addCleanupAction(std::function<void(void)>&& fn) = 0;
-    };
-
-    /// Simplified API to draw a frame, deals with cmdbuf allocation, recording and submission, as well as layout transitions in and out of VK_IMAGE_LAYOUT_GENERAL for the swapchain image
-    void renderFrameSimplified(std::function<void(SimplifiedRenderContext&)>&& fn);
-
-    void resize();
-
-    /// Waits until all the in-flight frames are done and runs their cleanup jobs
-    void drain();
-
-    class Impl;
-    std::unique_ptr<Impl> _impl;
-};
-
 struct FpsCounter {
     FpsCounter();
     FpsCounter(FpsCounter&) = delete;
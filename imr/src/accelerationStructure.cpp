@@ -10,7 +10,7 @@ struct AccelerationStructure::Impl {
 
     ~Impl();
 
-    void createAccelerationStructure(VkAccelerationStructureTypeKHR asType, std::vector<VkAccelerationStructureGeometryKHR>& geometries, std::vector<uint32_t> geometry_sizes);
+    Device::Job createAccelerationStructure(VkAccelerationStructureTypeKHR asType, std::vector<VkAccelerationStructureGeometryKHR>& geometries, std::vector<uint32_t> geometry_sizes);
 };
 
 AccelerationStructure::AccelerationStructure(Device& device) {
@@ -74,7 +74,10 @@ void AccelerationStructure::createBottomLevelAccelerationStructure(std::vector<A
     for (auto& geom : geometries) {
         geometries_ptrs.push_back(&geom);
     }
-    _impl->createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, geometries, geometries_prim_count);
+    auto job = _impl->createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, geometries, geometries_prim_count);
+    job.then([transform_buffers = std::make_shared<decltype(transform_buffers)>(std::move(transform_buffers))]() {
+        transform_buffers->clear();
+    });
 }
 
 void AccelerationStructure::createTopLevelAccelerationStructure(std::vector<std::tuple<VkTransformMatrixKHR, AccelerationStructure*>>& bottomLevelAS)
@@ -109,12 +112,15 @@ void AccelerationStructure::createTopLevelAccelerationStructure(std::vector<std:
     accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;
 
     std::vector<VkAccelerationStructureGeometryKHR> oh_boy = { accelerationStructureGeometry };
-    _impl->createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, oh_boy, { (uint32_t) bottomLevelAS.size() });
+    auto job = _impl->createAccelerationStructure(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, oh_boy, { (uint32_t) bottomLevelAS.size() });
+    job.then([instanceBuffer = instanceBuffer.release()]() {
+        delete instanceBuffer;
+    });
 }
 
 // VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR
 
-void AccelerationStructure::Impl::createAccelerationStructure(VkAccelerationStructureTypeKHR asType, std::vector<VkAccelerationStructureGeometryKHR>& geometries, std::vector<uint32_t> geometry_sizes)
+Device::Job AccelerationStructure::Impl::createAccelerationStructure(VkAccelerationStructureTypeKHR asType, std::vector<VkAccelerationStructureGeometryKHR>& geometries, std::vector<uint32_t> geometry_sizes)
 {
     auto& vk = device.dispatch;
 
@@ -168,25 +174,31 @@ void AccelerationStructure::Impl::createAccelerationStructure(VkAccelerationStru
 
     auto lmao2 = accelerationStructureBuildRangeInfos.data();
 
-    // Build the acceleration structure on the device via a one-time command buffer submission
+    // Build the acceleration structure on the device, batched with the other async jobs so many builds don't each pay for a round trip
     // Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-    device.executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+    auto job = device.executeCommandsAsync([&](VkCommandBuffer cmdbuf) {
             vk.cmdBuildAccelerationStructuresKHR(
                     cmdbuf,
                     1,
                     &accelerationStructureBuildGeometryInfo,
                     &lmao2);
             });
+    job.then([scratchBuffer = scratchBuffer.release()]() {
+        delete scratchBuffer;
+    });
+
     VkAccelerationStructureDeviceAddressInfoKHR accelerationDeviceAddressInfo{};
     accelerationDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
     accelerationDeviceAddressInfo.accelerationStructure = handle;
     deviceAddress = vk.getAccelerationStructureDeviceAddressKHR(&accelerationDeviceAddressInfo);
+    return job;
 }
 
 AccelerationStructure::~AccelerationStructure() {
 }
 
 AccelerationStructure::Impl::~Impl() {
+    forget_launch_binding(device, handle);
     device.dispatch.destroyAccelerationStructureKHR(handle, nullptr);
 }
 
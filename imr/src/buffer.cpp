@@ -41,38 +41,229 @@ VkDeviceAddress Buffer::device_address() {
     }));
 }
 
+static StagingRing& get_staging_ring(Device& device) {
+    std::call_once(device._impl->staging_ring_created, [&]() {
+        device._impl->staging_ring = std::make_unique<StagingRing>(device, StagingRing::default_size);
+    });
+    return *device._impl->staging_ring;
+}
+
 void Buffer::uploadDataSync(uint64_t offset, uint64_t size, void* data) {
     auto& device = _impl->device;
+    if (size == 0)
+        return;
     if (_impl->memory_property & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-        void* mapped_buffer;
-        CHECK_VK_THROW(vkMapMemory(device.device, memory, memory_offset, size, 0, (void**) &mapped_buffer));
-        memcpy(mapped_buffer, data, size);
-        vkUnmapMemory(device.device, memory);
+        // through VMA, which reference counts the mappings of the block this buffer shares with others
+        uint8_t* mapped_buffer;
+        CHECK_VK_THROW(vmaMapMemory(device._impl->allocator, _impl->allocation, (void**) &mapped_buffer));
+        memcpy(mapped_buffer + offset, data, size);
+        // no-op for coherent memory
+        VkResult flushed = vmaFlushAllocation(device._impl->allocator, _impl->allocation, offset, size);
+        vmaUnmapMemory(device._impl->allocator, _impl->allocation);
+        CHECK_VK_THROW(flushed);
     } else if (_impl->usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) {
-        // TODO: be less ridiculous, import host memory
-        auto staging = imr::Buffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-        staging.uploadDataSync(0, size, data);
+        auto copy = [&](VkBuffer src, uint64_t src_offset) {
+            device.executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+                vkCmdCopyBuffer2(cmdbuf, tmpPtr<VkCopyBufferInfo2>({
+                    .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
+                    .srcBuffer = src,
+                    .dstBuffer = handle,
+                    .regionCount = 1,
+                    .pRegions = tmpPtr<VkBufferCopy2>({
+                        .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
+                        .srcOffset = src_offset,
+                        .dstOffset = offset,
+                        .size = size,
+                    })
+                }));
+            });
+        };
+
+        auto& ring = get_staging_ring(device);
+        if (auto staged = ring.allocate(size)) {
+            memcpy(staged->mapped, data, size);
+            copy(ring.buffer, staged->offset);
+            ring.release(*staged);
+        } else {
+            // Doesn't fit in what's left of the ring, use a dedicated staging buffer
+            auto staging = imr::Buffer(device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+            staging.uploadDataSync(0, size, data);
+            copy(staging.handle, 0);
+        }
+    } else {
+        throw std::runtime_error("Error: This buffer was allocated without VK_BUFFER_USAGE_TRANSFER_DST_BIT or VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, we cannot do a host->GPU copy to it!");
+    }
+}
+
+/// Copies `data` somewhere the GPU can copy it from, the returned function gives the space back once that copy has executed
+static std::tuple<VkBuffer, uint64_t, std::function<void()>> stage_upload(Device& device, std::span<const std::byte> data) {
+    auto& ring = get_staging_ring(device);
+    if (auto staged = ring.allocate(data.size())) {
+        memcpy(staged->mapped, data.data(), data.size());
+        return { ring.buffer, staged->offset, [&ring, allocation = *staged]() {
+            ring.release(allocation);
+        } };
+    }
+
+    // The ring is exhausted, fall back to a dedicated staging buffer
+    auto staging = new imr::Buffer(device, data.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    staging->uploadDataSync(0, data.size(), const_cast<std::byte*>(data.data()));
+    return { staging->handle, 0, [=]() {
+        delete staging;
+    } };
+}
+
+static void record_upload_copy(Device& device, VkCommandBuffer cmdbuf, VkBuffer src, uint64_t src_offset, VkBuffer dst, uint64_t offset, uint64_t size) {
+    auto& vk = device.dispatch;
+
+    // before: anything previously submitted that might touch this buffer
+    // after: the copy
+    vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr<VkDependencyInfo>({
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers = tmpPtr<VkBufferMemoryBarrier2>({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .srcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .buffer = dst,
+            .offset = offset,
+            .size = size,
+        }),
+    }));
+
+    vkCmdCopyBuffer2(cmdbuf, tmpPtr<VkCopyBufferInfo2>({
+        .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
+        .srcBuffer = src,
+        .dstBuffer = dst,
+        .regionCount = 1,
+        .pRegions = tmpPtr<VkBufferCopy2>({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
+            .srcOffset = src_offset,
+            .dstOffset = offset,
+            .size = size,
+        })
+    }));
+
+    // before: the copy
+    // after: everything recorded after it
+    vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr<VkDependencyInfo>({
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers = tmpPtr<VkBufferMemoryBarrier2>({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+            .buffer = dst,
+            .offset = offset,
+            .size = size,
+        }),
+    }));
+}
+
+void Buffer::uploadDataAsync(VkCommandBuffer cmdbuf, Swapchain::Frame& frame, uint64_t offset, std::span<const std::byte> data) {
+    auto& device = _impl->device;
+    if (data.empty())
+        return;
+
+    // Even host-visible buffers go through a copy: earlier frames may still be reading the old contents
+    if (!(_impl->usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+        throw std::runtime_error("Error: This buffer was allocated without VK_BUFFER_USAGE_TRANSFER_DST_BIT, we cannot record a copy to it!");
+
+    auto [src, src_offset, release] = stage_upload(device, data);
+    frame.addCleanupAction(std::move(release));
+    record_upload_copy(device, cmdbuf, src, src_offset, handle, offset, data.size());
+}
+
+Device::Job Buffer::uploadDataAsync(uint64_t offset, std::span<const std::byte> data) {
+    auto& device = _impl->device;
+
+    if (!(_impl->usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+        throw std::runtime_error("Error: This buffer was allocated without VK_BUFFER_USAGE_TRANSFER_DST_BIT, we cannot record a copy to it!");
+    // nothing to copy, but the caller still gets a job that completes in order with the others
+    if (data.empty())
+        return device.executeCommandsAsync([](VkCommandBuffer) {});
 
+    VkBuffer src;
+    uint64_t src_offset;
+    std::function<void()> release;
+    std::tie(src, src_offset, release) = stage_upload(device, data);
+    auto job = device.executeCommandsAsync([&](VkCommandBuffer cmdbuf) {
+        record_upload_copy(device, cmdbuf, src, src_offset, handle, offset, data.size());
+    });
+    job.then(std::move(release));
+    return job;
+}
+
+void Buffer::uploadDataAsync(Swapchain::SimplifiedRenderContext& context, uint64_t offset, std::span<const std::byte> data) {
+    uploadDataAsync(context.cmdbuf(), context.frame(), offset, data);
+}
+
+void Buffer::downloadDataSync(uint64_t offset, uint64_t size, void* data) {
+    auto& device = _impl->device;
+    if (size == 0)
+        return;
+    if (_impl->memory_property & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        uint8_t* mapped_buffer;
+        CHECK_VK_THROW(vmaMapMemory(device._impl->allocator, _impl->allocation, (void**) &mapped_buffer));
+        // no-op for coherent memory
+        VkResult invalidated = vmaInvalidateAllocation(device._impl->allocator, _impl->allocation, offset, size);
+        if (invalidated == VK_SUCCESS)
+            memcpy(data, mapped_buffer + offset, size);
+        vmaUnmapMemory(device._impl->allocator, _impl->allocation);
+        CHECK_VK_THROW(invalidated);
+    } else if (_impl->usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) {
+        auto staging = imr::Buffer(device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
         device.executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+            // before: anything previously submitted that writes to this buffer
+            // after: the copy
+            device.dispatch.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr<VkDependencyInfo>({
+                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                .memoryBarrierCount = 1,
+                .pMemoryBarriers = tmpPtr<VkMemoryBarrier2>({
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                    .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                    .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+                }),
+            }));
             vkCmdCopyBuffer2(cmdbuf, tmpPtr<VkCopyBufferInfo2>({
                 .sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2,
-                .srcBuffer = staging.handle,
-                .dstBuffer = handle,
+                .srcBuffer = handle,
+                .dstBuffer = staging.handle,
                 .regionCount = 1,
                 .pRegions = tmpPtr<VkBufferCopy2>({
                     .sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2,
-                    .srcOffset = 0,
-                    .dstOffset = offset,
+                    .srcOffset = offset,
+                    .dstOffset = 0,
                     .size = size,
                 })
             }));
+            // makes the copy visible to the host once the submission has completed
+            device.dispatch.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr<VkDependencyInfo>({
+                .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                .memoryBarrierCount = 1,
+                .pMemoryBarriers = tmpPtr<VkMemoryBarrier2>({
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                    .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                    .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    .dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+                    .dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+                }),
+            }));
         });
+        staging.downloadDataSync(0, size, data);
     } else {
-        throw std::runtime_error("Error: This buffer was allocated without VK_BUFFER_USAGE_TRANSFER_DST_BIT or VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, we cannot do a host->GPU copy to it!");
+        throw std::runtime_error("Error: This buffer was allocated without VK_BUFFER_USAGE_TRANSFER_SRC_BIT or VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, we cannot do a GPU->host copy from it!");
     }
 }
 
 Buffer::~Buffer() {
+    forget_launch_binding(_impl->device, handle);
     vmaDestroyBuffer(_impl->device._impl->allocator, handle, _impl->allocation);
 }
 
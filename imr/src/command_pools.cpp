@@ -0,0 +1,100 @@
+#include "swapchain_private.h"
+
+namespace imr {
+
+VkCommandPool create_command_pool(Device& device, uint32_t queue_family) {
+    VkCommandPool pool;
+    CHECK_VK(vkCreateCommandPool(device.device, tmpPtr<VkCommandPoolCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .queueFamilyIndex = queue_family,
+    }), nullptr, &pool), throw std::runtime_error("failed to create cmdpool"));
+    return pool;
+}
+
+/// Hands a thread's pools back when it exits. Threads come and go (std::async, worker pools...) and their ids get recycled, neither the pools nor the ids should outlive them.
+struct ThreadCommandPools {
+    std::vector<std::weak_ptr<CommandPoolsOwner>> owners;
+
+    ~ThreadCommandPools() {
+        auto thread = std::this_thread::get_id();
+        for (auto& weak_owner : owners) {
+            auto owner = weak_owner.lock();
+            if (!owner)
+                continue;
+            std::lock_guard owner_lock(owner->mutex);
+            if (!owner->device)
+                continue;
+            auto& device = *owner->device;
+            std::lock_guard lock(device._impl->command_pools_mutex);
+            auto& pools = device._impl->thread_command_pools;
+            for (auto it = pools.begin(); it != pools.end();) {
+                auto [owner_thread, queue_family] = it->first;
+                // Device::pool belongs to the device, even if the thread that created it is gone
+                if (owner_thread != thread || it->second == device.pool) {
+                    ++it;
+                    continue;
+                }
+                // frames borrow pools for the main queue, anything else is of no use to anyone
+                if (queue_family == device.main_queue_idx) {
+                    vkResetCommandPool(device.device, it->second, 0);
+                    device._impl->spare_command_pools.push_back(it->second);
+                } else {
+                    vkDestroyCommandPool(device.device, it->second, nullptr);
+                }
+                it = pools.erase(it);
+            }
+        }
+    }
+};
+
+static thread_local ThreadCommandPools this_thread_command_pools;
+
+VkCommandPool Device::threadCommandPool(uint32_t queue_family) {
+    std::lock_guard lock(_impl->command_pools_mutex);
+    auto& pool = _impl->thread_command_pools[{ std::this_thread::get_id(), queue_family }];
+    if (!pool) {
+        pool = create_command_pool(*this, queue_family);
+        this_thread_command_pools.owners.push_back(_impl->command_pools_owner);
+    }
+    return pool;
+}
+
+VkCommandPool Device::threadCommandPool() {
+    return threadCommandPool(main_queue_idx);
+}
+
+VkCommandBuffer Swapchain::Frame::allocateCommandBuffer(VkCommandBufferLevel level) {
+    auto& device = _impl->device;
+    auto thread = std::this_thread::get_id();
+
+    VkCommandPool pool = VK_NULL_HANDLE;
+    {
+        std::lock_guard lock(device._impl->command_pools_mutex);
+        for (auto& [owner, borrowed] : _impl->command_pools) {
+            if (owner == thread)
+                pool = borrowed;
+        }
+        if (!pool) {
+            auto& spares = device._impl->spare_command_pools;
+            if (!spares.empty()) {
+                pool = spares.back();
+                spares.pop_back();
+            } else {
+                pool = create_command_pool(device, device.main_queue_idx);
+            }
+            _impl->command_pools.emplace_back(thread, pool);
+        }
+    }
+
+    // the pool is only ever used by this thread for the lifetime of the frame, no need to hold the lock
+    VkCommandBuffer cmdbuf;
+    CHECK_VK_THROW(vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = pool,
+        .level = level,
+        .commandBufferCount = 1,
+    }), &cmdbuf));
+    return cmdbuf;
+}
+
+}
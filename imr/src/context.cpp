@@ -2,28 +2,47 @@
 
 namespace imr {
 
-Context::Context(std::function<void(vkb::InstanceBuilder&)>&& instance_custom) {
-    auto instance_builder = vkb::InstanceBuilder()
+static vkb::InstanceBuilder make_default_instance_builder() {
+    return vkb::InstanceBuilder()
         .use_default_debug_messenger()
         .request_validation_layers()
         .set_minimum_instance_version(1, 3, 0)
-        .enable_extension("VK_KHR_get_surface_capabilities2")
-        //.enable_extension("VK_EXT_surface_maintenance1")
         .require_api_version(1, 3, 0);
+}
 
-    instance_custom(instance_builder);
-
+static void build_instance(Context& context, vkb::InstanceBuilder& instance_builder) {
     if (auto built = instance_builder
         .build(); built.has_value())
     {
-        instance = built.value();
-        dispatch = instance.make_table();
+        context.instance = built.value();
+        context.dispatch = context.instance.make_table();
     } else {
         printf("%s\n", built.error().message().c_str());
         throw std::runtime_error("failed to build instance");
     }
 }
 
+Context::Context(std::function<void(vkb::InstanceBuilder&)>&& instance_custom) {
+    auto instance_builder = make_default_instance_builder()
+        .enable_extension("VK_KHR_get_surface_capabilities2");
+
+    if (auto system_info = vkb::SystemInfo::get_system_info(); system_info.has_value() && system_info->is_extension_available("VK_EXT_surface_maintenance1")) {
+        instance_builder.enable_extension("VK_EXT_surface_maintenance1");
+        surface_maintenance1 = true;
+    }
+
+    instance_custom(instance_builder);
+    build_instance(*this, instance_builder);
+}
+
+Context::Context(Headless, std::function<void(vkb::InstanceBuilder&)>&& instance_custom) : headless(true) {
+    auto instance_builder = make_default_instance_builder()
+        .set_headless();
+
+    instance_custom(instance_builder);
+    build_instance(*this, instance_builder);
+}
+
 Context::~Context() {
     vkb::destroy_instance(instance);
 }
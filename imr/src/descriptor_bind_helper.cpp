@@ -10,7 +10,10 @@ struct DescriptorBindHelper::Impl {
 
     unsigned nsets;
     VkDescriptorSet* sets;
-    VkDescriptorPool pool;
+    /// Only for layouts the device's DescriptorPoolRing can't serve, sets come from there otherwise
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    /// The ring pool of each set allocated from it, they're given back when the helper goes away
+    std::vector<VkDescriptorPool> ring_pools;
 
     std::vector<std::function<void(void)>> cleanup;
     bool committed = false;
@@ -18,6 +21,19 @@ struct DescriptorBindHelper::Impl {
     Impl(Device& device, PipelineLayout& layout, ReflectedLayout& reflected, VkPipelineBindPoint bind_point) : device(device), layout(layout), reflected(reflected), bind_point(bind_point) {
         auto& vk = device.dispatch;
         nsets = reflected.set_bindings.size();
+        sets = reinterpret_cast<VkDescriptorSet*>(calloc(nsets, sizeof(VkDescriptorSet)));
+
+        auto& ring = get_descriptor_pools(device);
+        bool ring_serves = true;
+        for (auto& [set, bindings] : reflected.set_bindings) {
+            std::unordered_map<VkDescriptorType, uint32_t> set_counts;
+            for (auto& binding : bindings) {
+                set_counts[binding.descriptorType] += binding.descriptorCount;
+                ring_serves &= ring.serves(binding.descriptorType) && set_counts[binding.descriptorType] <= DescriptorPoolRing::descriptors_per_type;
+            }
+        }
+        if (ring_serves)
+            return;
 
         std::unordered_map<VkDescriptorType, uint32_t> descriptor_counts;
         auto access_map = [&](VkDescriptorType key) -> uint32_t& {
@@ -47,13 +63,13 @@ struct DescriptorBindHelper::Impl {
             .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
             .pPoolSizes = pool_sizes.data(),
         }), nullptr, &pool);
-
-        sets = reinterpret_cast<VkDescriptorSet*>(calloc(nsets, sizeof(VkDescriptorSet)));
     }
 
     // Lazily allocates the set if we need it
     VkDescriptorSet get_or_create_set(unsigned set) {
-        if (sets[set] == 0) {
+        if (sets[set] == 0 && !pool) {
+            ring_pools.push_back(get_descriptor_pools(device).allocate(layout.set_layouts[set], sets[set]));
+        } else if (sets[set] == 0) {
             CHECK_VK_THROW(vkAllocateDescriptorSets(device.device, tmpPtr<VkDescriptorSetAllocateInfo>({
                 .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
                 .descriptorPool = pool,
@@ -66,7 +82,10 @@ struct DescriptorBindHelper::Impl {
 
     ~Impl() {
         free(sets);
-        vkDestroyDescriptorPool(device.device, pool, nullptr);
+        if (pool)
+            vkDestroyDescriptorPool(device.device, pool, nullptr);
+        for (auto ring_pool : ring_pools)
+            get_descriptor_pools(device).release(ring_pool);
 
         for (auto& fn : cleanup) {
             fn();
@@ -0,0 +1,113 @@
+#include "imr_private.h"
+
+#include <algorithm>
+
+namespace imr {
+
+/// What the examples and the bind helpers use, plus acceleration structures if the device has them
+static const VkDescriptorType pooled_types[] = {
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+};
+
+bool DescriptorPoolRing::serves(VkDescriptorType type) const {
+    if (type == VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR)
+        return acceleration_structures;
+    return std::find(std::begin(pooled_types), std::end(pooled_types), type) != std::end(pooled_types);
+}
+
+DescriptorPoolRing& get_descriptor_pools(Device& device) {
+    std::call_once(device._impl->descriptor_pools_created, [&]() {
+        device._impl->descriptor_pools = std::make_unique<DescriptorPoolRing>(device);
+    });
+    return *device._impl->descriptor_pools;
+}
+
+DescriptorPoolRing::DescriptorPoolRing(Device& device) : device(device) {
+    auto enabled = device.physical_device.get_extensions();
+    acceleration_structures = std::find(enabled.begin(), enabled.end(), "VK_KHR_acceleration_structure") != enabled.end();
+}
+
+VkDescriptorPool DescriptorPoolRing::create_pool() {
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (auto type : pooled_types)
+        pool_sizes.push_back({ .type = type, .descriptorCount = descriptors_per_type });
+    if (acceleration_structures)
+        pool_sizes.push_back({ .type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, .descriptorCount = descriptors_per_type });
+
+    VkDescriptorPool pool;
+    // no VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT: sets are never freed one by one, which lets drivers allocate them linearly
+    CHECK_VK_THROW(vkCreateDescriptorPool(device.device, tmpPtr<VkDescriptorPoolCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = 0,
+        .maxSets = sets_per_pool,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data(),
+    }), nullptr, &pool));
+    return pool;
+}
+
+VkDescriptorPool DescriptorPoolRing::allocate(VkDescriptorSetLayout set_layout, VkDescriptorSet& set) {
+    std::lock_guard lock(mutex);
+    while (true) {
+        // a pool that was just reset can't be too full, only too small
+        bool fresh = !current;
+        if (fresh) {
+            if (spare.empty()) {
+                current = create_pool();
+            } else {
+                current = spare.back();
+                spare.pop_back();
+            }
+        }
+
+        VkResult result = vkAllocateDescriptorSets(device.device, tmpPtr<VkDescriptorSetAllocateInfo>({
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = current,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &set_layout,
+        }), &set);
+        if (result == VK_SUCCESS) {
+            live_sets[current]++;
+            return current;
+        }
+        if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || fresh)
+            throw std::runtime_error("Failed to allocate a descriptor set");
+
+        // full, retire it. If its sets are all gone already it can be reset right away.
+        if (live_sets[current] == 0) {
+            live_sets.erase(current);
+            vkResetDescriptorPool(device.device, current, 0);
+            spare.push_back(current);
+        }
+        current = VK_NULL_HANDLE;
+    }
+}
+
+void DescriptorPoolRing::release(VkDescriptorPool pool) {
+    std::lock_guard lock(mutex);
+    auto& count = live_sets[pool];
+    assert(count > 0);
+    if (--count == 0 && pool != current) {
+        live_sets.erase(pool);
+        vkResetDescriptorPool(device.device, pool, 0);
+        spare.push_back(pool);
+    }
+}
+
+DescriptorPoolRing::~DescriptorPoolRing() {
+    // whatever is left in live_sets belongs to helpers that were never deleted
+    std::set<VkDescriptorPool> pools(spare.begin(), spare.end());
+    for (auto& [pool, count] : live_sets)
+        pools.insert(pool);
+    if (current)
+        pools.insert(current);
+    for (auto pool : pools)
+        vkDestroyDescriptorPool(device.device, pool, nullptr);
+}
+
+}
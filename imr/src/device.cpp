@@ -21,6 +21,10 @@ static auto make_default_device_selector(Context& context) {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES,
             .bufferDeviceAddress = true,
         }))
+        .add_required_extension_features(VkPhysicalDeviceTimelineSemaphoreFeatures({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+            .timelineSemaphore = true,
+        }))
         .add_required_extension_features(VkPhysicalDeviceSynchronization2FeaturesKHR({
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
             .pNext = nullptr,
@@ -51,37 +55,188 @@ Device::Device(Context& context, std::function<void(vkb::PhysicalDeviceSelector&
         throw std::runtime_error("failed to select a device");
 })()) {}
 
+/// Turns on whatever optional extensions (and their features) the device has, this must happen before the device gets built.
+/// Nothing optional goes through the selector: it would enable every extension it finds, regardless of the conditions checked here.
+static Device::Capabilities negotiate_optional_extensions(Context& context, vkb::PhysicalDevice& physical_device) {
+    Device::Capabilities capabilities;
+
+    capabilities.descriptor_buffer = physical_device.enable_extension_if_present("VK_EXT_descriptor_buffer")
+        && physical_device.enable_extension_features_if_present(VkPhysicalDeviceDescriptorBufferFeaturesEXT({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+            .descriptorBuffer = true,
+        }));
+    capabilities.push_descriptor = physical_device.enable_extension_if_present("VK_KHR_push_descriptor");
+    capabilities.mesh_shader = physical_device.enable_extension_if_present("VK_EXT_mesh_shader")
+        && physical_device.enable_extension_features_if_present(VkPhysicalDeviceMeshShaderFeaturesEXT({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+            .taskShader = true,
+            .meshShader = true,
+        }));
+    capabilities.memory_budget = physical_device.enable_extension_if_present("VK_EXT_memory_budget");
+    capabilities.host_image_copy = physical_device.enable_extension_if_present("VK_EXT_host_image_copy")
+        && physical_device.enable_extension_features_if_present(VkPhysicalDeviceHostImageCopyFeaturesEXT({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+            .hostImageCopy = true,
+        }));
+    capabilities.graphics_pipeline_library = physical_device.enable_extensions_if_present({ "VK_KHR_pipeline_library", "VK_EXT_graphics_pipeline_library" })
+        && physical_device.enable_extension_features_if_present(VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+            .graphicsPipelineLibrary = true,
+        }));
+    if (physical_device.properties.apiVersion >= VK_API_VERSION_1_3)
+        capabilities.extended_dynamic_state = true;
+    else
+        capabilities.extended_dynamic_state = physical_device.enable_extensions_if_present({ "VK_EXT_extended_dynamic_state", "VK_EXT_extended_dynamic_state2" })
+            && physical_device.enable_extension_features_if_present(VkPhysicalDeviceExtendedDynamicStateFeaturesEXT({
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+                .extendedDynamicState = true,
+            }))
+            && physical_device.enable_extension_features_if_present(VkPhysicalDeviceExtendedDynamicState2FeaturesEXT({
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT,
+                .extendedDynamicState2 = true,
+            }));
+    capabilities.extended_dynamic_state3 = physical_device.enable_extension_if_present("VK_EXT_extended_dynamic_state3")
+        && physical_device.enable_extension_features_if_present(VkPhysicalDeviceExtendedDynamicState3FeaturesEXT({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+            .extendedDynamicState3PolygonMode = true,
+            .extendedDynamicState3ColorBlendEnable = true,
+            .extendedDynamicState3ColorBlendEquation = true,
+            .extendedDynamicState3ColorWriteMask = true,
+        }));
+
+    VkPhysicalDeviceSubgroupSizeControlProperties subgroup_size_control = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES,
+    };
+    VkPhysicalDeviceSubgroupProperties subgroup = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+    };
+    bool has_subgroup_size_control = physical_device.properties.apiVersion >= VK_API_VERSION_1_3 || physical_device.enable_extension_if_present("VK_EXT_subgroup_size_control");
+    if (has_subgroup_size_control)
+        subgroup.pNext = &subgroup_size_control;
+    vkGetPhysicalDeviceProperties2(physical_device, tmpPtr<VkPhysicalDeviceProperties2>({
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &subgroup,
+    }));
+    capabilities.subgroup_size = subgroup.subgroupSize;
+    // only compute pipelines make use of it so far
+    capabilities.subgroup_size_control = has_subgroup_size_control
+        && (subgroup_size_control.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT)
+        && physical_device.enable_extension_features_if_present(VkPhysicalDeviceSubgroupSizeControlFeatures({
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES,
+            .subgroupSizeControl = true,
+            .computeFullSubgroups = true,
+        }));
+    if (capabilities.subgroup_size_control) {
+        capabilities.min_subgroup_size = subgroup_size_control.minSubgroupSize;
+        capabilities.max_subgroup_size = subgroup_size_control.maxSubgroupSize;
+    }
+
+    // present_wait is useless without present_id, and neither makes sense without a surface
+    if (!context.headless) {
+        capabilities.present_wait = physical_device.enable_extensions_if_present({ "VK_KHR_present_id", "VK_KHR_present_wait" })
+            && physical_device.enable_extension_features_if_present(VkPhysicalDevicePresentIdFeaturesKHR({
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+                .presentId = true,
+            }))
+            && physical_device.enable_extension_features_if_present(VkPhysicalDevicePresentWaitFeaturesKHR({
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+                .presentWait = true,
+            }));
+        capabilities.swapchain_maintenance1 = context.surface_maintenance1
+            && physical_device.enable_extension_if_present("VK_EXT_swapchain_maintenance1")
+            && physical_device.enable_extension_features_if_present(VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT({
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT,
+                .swapchainMaintenance1 = true,
+            }));
+    }
+
+    return capabilities;
+}
+
+static std::optional<uint32_t> find_graphics_present_family(Context& context, vkb::PhysicalDevice& physical_device) {
+    auto families = physical_device.get_queue_families();
+    for (uint32_t i = 0; i < families.size(); i++) {
+        if ((families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && glfwGetPhysicalDevicePresentationSupport(context.instance, physical_device, i))
+            return i;
+    }
+    return std::nullopt;
+}
+
 Device::Device(imr::Context& context, vkb::PhysicalDevice physical_device) : context(context), physical_device(physical_device) {
     _impl = std::make_unique<Impl>();
+    _impl->command_pools_owner = std::make_shared<CommandPoolsOwner>();
+    _impl->command_pools_owner->device = this;
+
+    capabilities = negotiate_optional_extensions(context, this->physical_device);
 
-    if (auto built = vkb::DeviceBuilder(physical_device)
+    if (auto built = vkb::DeviceBuilder(this->physical_device)
             .build(); built.has_value())
     {
         device = built.value();
         dispatch = device.make_table();
     }
 
-    main_queue_idx = device.get_queue_index(vkb::QueueType((int) vkb::QueueType::graphics | (int) vkb::QueueType::present)).value();
-    main_queue = device.get_queue(vkb::QueueType((int) vkb::QueueType::graphics | (int) vkb::QueueType::present)).value();
+    // windowed contexts need the main queue to present too, the surfaces only exist later so ask GLFW about the family instead
+    // vk-bootstrap's graphics queue doesn't check that, it's only good enough for headless contexts (or when GLFW can't tell us)
+    if (auto idx = context.headless ? std::nullopt : find_graphics_present_family(context, this->physical_device); idx.has_value()) {
+        main_queue_idx = *idx;
+        vkGetDeviceQueue(device, main_queue_idx, 0, &main_queue);
+    } else {
+        main_queue_idx = device.get_queue_index(vkb::QueueType::graphics).value();
+        main_queue = device.get_queue(vkb::QueueType::graphics).value();
+    }
 
-    CHECK_VK(vkCreateCommandPool(device, tmpPtr<VkCommandPoolCreateInfo>({
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .queueFamilyIndex = main_queue_idx,
-    }), nullptr, &pool), throw std::runtime_error("failed to create cmdpool"));
+    pool = threadCommandPool(main_queue_idx);
+
+    VmaAllocatorCreateFlags allocator_flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    // lets VMA track how much memory we can actually use instead of guessing from the heap sizes
+    if (capabilities.memory_budget)
+        allocator_flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
 
     CHECK_VK(vmaCreateAllocator(tmpPtr<VmaAllocatorCreateInfo>({
-        .flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT,
+        .flags = allocator_flags,
         .physicalDevice = physical_device,
         .device = device,
         .instance = context.instance,
     }), &_impl->allocator), throw std::runtime_error("failed to create VMA allocator"));
+
+    create_pipeline_cache(*this);
+    load_reflection_cache(*this);
+
+    CHECK_VK(vkCreateSemaphore(device, tmpPtr<VkSemaphoreCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = tmpPtr<VkSemaphoreTypeCreateInfo>({
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        }),
+    }), nullptr, &_impl->timeline), throw std::runtime_error("failed to create timeline semaphore"));
 }
 
 Device::~Device() {
+    {
+        // threads exiting from now on keep their pools to themselves, they get destroyed below
+        std::lock_guard lock(_impl->command_pools_owner->mutex);
+        _impl->command_pools_owner->device = nullptr;
+    }
+
+    // outstanding jobs might hold on to resources that their callbacks free
+    wait(flushJobs());
+    pollJobs();
     vkDeviceWaitIdle(device);
 
+    save_reflection_cache(*this);
+    destroy_pipeline_cache(*this);
+    _impl->staging_ring.reset();
+    _impl->descriptor_pools.reset();
+    vkDestroySemaphore(device, _impl->timeline, nullptr);
     vmaDestroyAllocator(_impl->allocator);
-    vkDestroyCommandPool(device, pool, nullptr);
+    for (auto& [key, thread_pool] : _impl->thread_command_pools)
+        vkDestroyCommandPool(device, thread_pool, nullptr);
+    for (auto spare_pool : _impl->spare_command_pools)
+        vkDestroyCommandPool(device, spare_pool, nullptr);
+    if (_impl->jobs_pool)
+        vkDestroyCommandPool(device, _impl->jobs_pool, nullptr);
     vkb::destroy_device(device);
     _impl.reset();
 }
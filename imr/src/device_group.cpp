@@ -0,0 +1,132 @@
+#include "imr_private.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <numeric>
+#include <thread>
+
+namespace imr {
+
+/// One long-lived worker thread per device, dispatchSplit hands them its tasks instead of starting threads every time
+struct DeviceGroup::Impl {
+    struct Worker {
+        std::thread thread;
+        std::function<void()> task;
+    };
+
+    /// dispatchSplit calls take turns, each one uses every worker
+    std::mutex dispatch_mutex;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t busy = 0;
+    bool stop = false;
+
+    void work(Worker& worker) {
+        std::unique_lock lock(mutex);
+        while (true) {
+            wake.wait(lock, [&]() { return stop || worker.task; });
+            if (!worker.task)
+                return;
+            auto task = std::move(worker.task);
+            worker.task = nullptr;
+            lock.unlock();
+            task();
+            lock.lock();
+            if (--busy == 0)
+                done.notify_all();
+        }
+    }
+};
+
+DeviceGroup::DeviceGroup(Context& context, std::function<void(vkb::PhysicalDeviceSelector&)>&& device_custom) : DeviceGroup(context, context.available_devices(std::move(device_custom))) {}
+
+DeviceGroup::DeviceGroup(Context& context, std::vector<vkb::PhysicalDevice> physical_devices) {
+    if (physical_devices.empty())
+        throw std::runtime_error("DeviceGroup needs at least one device");
+    for (auto& physical_device : physical_devices)
+        devices.push_back(std::make_unique<Device>(context, physical_device));
+
+    _impl = std::make_unique<Impl>();
+    for (size_t i = 0; i < devices.size(); i++) {
+        auto& worker = *_impl->workers.emplace_back(std::make_unique<Impl::Worker>());
+        worker.thread = std::thread([this, &worker]() { _impl->work(worker); });
+    }
+}
+
+DeviceGroup::~DeviceGroup() {
+    {
+        std::lock_guard lock(_impl->mutex);
+        _impl->stop = true;
+    }
+    _impl->wake.notify_all();
+    // before the devices go, the workers give their command pools back as they exit
+    for (auto& worker : _impl->workers)
+        worker->thread.join();
+}
+
+size_t DeviceGroup::size() const { return devices.size(); }
+
+Device& DeviceGroup::operator[](size_t i) const { return *devices[i]; }
+
+std::vector<DeviceGroup::Range> DeviceGroup::split(uint32_t count, std::vector<float> weights) const {
+    if (weights.empty())
+        weights.resize(devices.size(), 1.0f);
+    assert(weights.size() == devices.size());
+    float total = std::accumulate(weights.begin(), weights.end(), 0.0f);
+
+    std::vector<Range> ranges;
+    float accumulated = 0.0f;
+    uint32_t begin = 0;
+    for (size_t i = 0; i < weights.size(); i++) {
+        accumulated += weights[i];
+        // the last device takes whatever rounding left over
+        uint32_t end = i + 1 == weights.size() ? count : static_cast<uint32_t>(count * (accumulated / total));
+        end = std::max(begin, std::min(end, count));
+        ranges.push_back({ begin, end });
+        begin = end;
+    }
+    return ranges;
+}
+
+void DeviceGroup::dispatchSplit(uint32_t count, std::function<void(size_t, Device&, VkCommandBuffer, Range)> record, std::vector<float> weights) {
+    auto ranges = split(count, std::move(weights));
+    std::lock_guard dispatch_lock(_impl->dispatch_mutex);
+
+    // every device has its own worker, so the submissions (and the waits) overlap
+    std::vector<std::exception_ptr> errors(devices.size());
+    {
+        std::unique_lock lock(_impl->mutex);
+        for (size_t i = 0; i < devices.size(); i++) {
+            if (ranges[i].count() == 0)
+                continue;
+            _impl->workers[i]->task = [&, i]() {
+                try {
+                    devices[i]->executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+                        record(i, *devices[i], cmdbuf, ranges[i]);
+                    });
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            };
+            _impl->busy++;
+        }
+        _impl->wake.notify_all();
+        _impl->done.wait(lock, [&]() { return _impl->busy == 0; });
+    }
+
+    for (auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+void DeviceGroup::gather(Buffer& src, Buffer& dst, uint64_t offset, uint64_t size) {
+    std::vector<std::byte> data(size);
+    src.downloadDataSync(offset, size, data.data());
+    dst.uploadDataSync(offset, size, data.data());
+}
+
+}
@@ -3,6 +3,7 @@
 namespace imr {
 
 void Device::executeCommandsSync(std::function<void(VkCommandBuffer)> lambda) {
+    VkCommandPool pool = threadCommandPool();
     VkCommandBuffer cmdbuf;
     vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -17,29 +18,220 @@ void Device::executeCommandsSync(std::function<void(VkCommandBuffer)> lambda) {
 
     lambda(cmdbuf);
 
-    VkFence fence;
-    vkCreateFence(device.device, tmpPtr<VkFenceCreateInfo>({
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = 0,
-    }), nullptr, &fence);
-
     vkEndCommandBuffer(cmdbuf);
-    vkQueueSubmit(main_queue, 1, tmpPtr<VkSubmitInfo>({
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 0,
-        .pWaitSemaphores = nullptr,
-        .pWaitDstStageMask = tmpPtr((VkPipelineStageFlags) VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT),
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuf,
-        .signalSemaphoreCount = 0,
-        .pSignalSemaphores = nullptr,
-    }), fence);
-
-    vkWaitForFences(device, 1, &fence, true, UINT64_MAX);
+    wait(submit({ cmdbuf }));
 
-    vkDestroyFence(device.device, fence, nullptr);
     vkFreeCommandBuffers(device.device, pool, 1, &cmdbuf);
 }
 
+/// `jobs` is set for async job batches, everything else waits on the batches submitted before it
+static uint64_t queue_submit(Device& device, std::vector<VkCommandBuffer>& cmdbufs, std::vector<VkSemaphoreSubmitInfo>& wait, std::vector<VkSemaphoreSubmitInfo>& signal, VkFence fence, bool jobs = false) {
+    // Tickets have to reach the queue in the order they are handed out
+    std::lock_guard lock(device._impl->queue_mutex);
+    uint64_t ticket = device._impl->last_ticket + 1;
+
+    // Deciding this under the queue lock means concurrent submissions can't both skip the wait
+    bool waits_on_jobs = !jobs && device._impl->submitted_jobs_ticket > device._impl->waited_jobs_ticket;
+    if (waits_on_jobs)
+        wait.push_back(device.dependency(device._impl->submitted_jobs_ticket));
+
+    std::vector<VkCommandBufferSubmitInfo> cmdbuf_infos;
+    for (auto cmdbuf : cmdbufs) {
+        cmdbuf_infos.push_back({
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .commandBuffer = cmdbuf,
+        });
+    }
+
+    signal.push_back({
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = device._impl->timeline,
+        .value = ticket,
+        .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+    });
+
+    // through the dispatch table: 1.2 devices only have it from VK_KHR_synchronization2
+    CHECK_VK_THROW(device.dispatch.queueSubmit2KHR(device.main_queue, 1, tmpPtr<VkSubmitInfo2>({
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+        .waitSemaphoreInfoCount = static_cast<uint32_t>(wait.size()),
+        .pWaitSemaphoreInfos = wait.data(),
+        .commandBufferInfoCount = static_cast<uint32_t>(cmdbuf_infos.size()),
+        .pCommandBufferInfos = cmdbuf_infos.data(),
+        .signalSemaphoreInfoCount = static_cast<uint32_t>(signal.size()),
+        .pSignalSemaphoreInfos = signal.data(),
+    }), fence));
+
+    // only consume the ticket once we know it will eventually be signalled
+    device._impl->last_ticket = ticket;
+    for (auto cmdbuf : cmdbufs) {
+        auto found = device._impl->recording_tickets.find(cmdbuf);
+        if (found != device._impl->recording_tickets.end()) {
+            found->second->ticket = ticket;
+            device._impl->recording_tickets.erase(found);
+        }
+    }
+    if (jobs)
+        device._impl->submitted_jobs_ticket = ticket;
+    else if (waits_on_jobs)
+        device._impl->waited_jobs_ticket = device._impl->submitted_jobs_ticket;
+    return ticket;
+}
+
+std::shared_ptr<RecordingTicket> recording_ticket(Device& device, VkCommandBuffer cmdbuf) {
+    std::lock_guard lock(device._impl->queue_mutex);
+    auto& recording = device._impl->recording_tickets[cmdbuf];
+    if (!recording)
+        recording = std::make_shared<RecordingTicket>();
+    return recording;
+}
+
+uint64_t Device::submit(std::vector<VkCommandBuffer> cmdbufs, std::vector<VkSemaphoreSubmitInfo> wait, std::vector<VkSemaphoreSubmitInfo> signal, VkFence fence) {
+    // Async jobs recorded so far go first, and whatever we submit now gets to see their results
+    flushJobs();
+    return queue_submit(*this, cmdbufs, wait, signal, fence);
+}
+
+/// Expects jobs_mutex to be held
+static void flush_jobs_locked(Device& device) {
+    auto& batch = device._impl->pending_jobs;
+    if (!batch)
+        return;
+
+    CHECK_VK_THROW(vkEndCommandBuffer(batch->cmdbuf));
+    std::vector<VkCommandBuffer> cmdbufs = { batch->cmdbuf };
+    std::vector<VkSemaphoreSubmitInfo> wait;
+    std::vector<VkSemaphoreSubmitInfo> signal;
+    batch->ticket = queue_submit(device, cmdbufs, wait, signal, VK_NULL_HANDLE, true);
+
+    device._impl->last_jobs_ticket = batch->ticket;
+    device._impl->submitted_jobs.push_back(std::move(batch));
+    batch.reset();
+}
+
+Device::Job Device::executeCommandsAsync(std::function<void(VkCommandBuffer)> lambda) {
+    std::lock_guard lock(_impl->jobs_mutex);
+    auto& batch = _impl->pending_jobs;
+    if (!batch) {
+        if (!_impl->jobs_pool)
+            _impl->jobs_pool = create_command_pool(*this, main_queue_idx);
+
+        batch = std::make_shared<Job::Impl>(*this);
+        CHECK_VK_THROW(vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = _impl->jobs_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        }), &batch->cmdbuf));
+        CHECK_VK_THROW(vkBeginCommandBuffer(batch->cmdbuf, tmpPtr<VkCommandBufferBeginInfo>({
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        })));
+    } else {
+        // Jobs would otherwise be free to overlap, make them behave like they were submitted one after the other
+        dispatch.cmdPipelineBarrier2KHR(batch->cmdbuf, tmpPtr<VkDependencyInfo>({
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = tmpPtr<VkMemoryBarrier2>({
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .srcAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+            }),
+        }));
+    }
+
+    lambda(batch->cmdbuf);
+
+    Job job;
+    job._impl = batch;
+    if (++batch->jobs >= Job::Impl::max_jobs_per_batch)
+        flush_jobs_locked(*this);
+    return job;
+}
+
+uint64_t Device::flushJobs() {
+    std::lock_guard lock(_impl->jobs_mutex);
+    flush_jobs_locked(*this);
+    return _impl->last_jobs_ticket;
+}
+
+void Device::pollJobs() {
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard lock(_impl->jobs_mutex);
+        auto& submitted = _impl->submitted_jobs;
+        // batches complete in submission order, no need to look further than the first unfinished one
+        while (!submitted.empty() && is_done(submitted.front()->ticket)) {
+            auto batch = std::move(submitted.front());
+            submitted.pop_front();
+            vkFreeCommandBuffers(device.device, _impl->jobs_pool, 1, &batch->cmdbuf);
+            batch->retired = true;
+            for (auto& fn : batch->callbacks)
+                callbacks.push_back(std::move(fn));
+            batch->callbacks.clear();
+        }
+    }
+
+    // callbacks might well queue more jobs
+    for (auto& fn : callbacks)
+        fn();
+}
 
-}
\ No newline at end of file
+uint64_t Device::Job::ticket() const {
+    auto& device = _impl->device;
+    std::lock_guard lock(device._impl->jobs_mutex);
+    if (_impl->ticket == 0)
+        flush_jobs_locked(device);
+    return _impl->ticket;
+}
+
+void Device::Job::wait() const {
+    _impl->device.wait(ticket());
+    _impl->device.pollJobs();
+}
+
+bool Device::Job::is_done() const {
+    if (!_impl->device.is_done(ticket()))
+        return false;
+    _impl->device.pollJobs();
+    return true;
+}
+
+const Device::Job& Device::Job::then(std::function<void()> fn) const {
+    {
+        std::lock_guard lock(_impl->device._impl->jobs_mutex);
+        if (!_impl->retired) {
+            _impl->callbacks.push_back(std::move(fn));
+            return *this;
+        }
+    }
+    fn();
+    return *this;
+}
+
+void Device::wait(uint64_t ticket) {
+    CHECK_VK_THROW(vkWaitSemaphores(device, tmpPtr<VkSemaphoreWaitInfo>({
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &_impl->timeline,
+        .pValues = &ticket,
+    }), UINT64_MAX));
+}
+
+bool Device::is_done(uint64_t ticket) {
+    uint64_t value;
+    CHECK_VK_THROW(vkGetSemaphoreCounterValue(device, _impl->timeline, &value));
+    return value >= ticket;
+}
+
+VkSemaphoreSubmitInfo Device::dependency(uint64_t ticket, VkPipelineStageFlags2 stages) {
+    return {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        .semaphore = _impl->timeline,
+        .value = ticket,
+        .stageMask = stages,
+    };
+}
+
+}
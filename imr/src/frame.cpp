@@ -1,13 +1,15 @@
 #include "swapchain_private.h"
 #include "imr/util.h"
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
 namespace imr {
 
-void Swapchain::Frame::addCleanupFence(VkFence fence) {
-    _impl->cleanup_fences.push_back(fence);
+void Swapchain::Frame::addCleanupTicket(uint64_t ticket) {
+    // tickets retire in order, so waiting on the latest one covers all of them
+    _impl->cleanup_ticket = std::max(_impl->cleanup_ticket, ticket);
 }
 
 void Swapchain::Frame::addCleanupAction(std::function<void(void)>&& fn) {
@@ -19,9 +21,9 @@ Swapchain::Frame::Frame(Impl&& impl) {
 }
 
 Swapchain::Frame::Impl::Impl(Device& device, SwapchainSlot& slot) : device(device), slot(slot) {
-    auto vkb_swapchain = slot.swapchain._impl->swapchain;
-    VkExtent3D size = { vkb_swapchain.extent.width, vkb_swapchain.extent.height, 1 };
-    auto i = make_image_from(device, slot.image, VK_IMAGE_TYPE_2D, size, vkb_swapchain.image_format);
+    auto& swapchain = *slot.swapchain._impl;
+    VkExtent3D size = { swapchain.extent().width, swapchain.extent().height, 1 };
+    auto i = make_image_from(device, slot.image, VK_IMAGE_TYPE_2D, size, swapchain.format());
     image = std::make_unique<Image>(std::move(i));
 }
 
@@ -29,14 +31,22 @@ Image& Swapchain::Frame::image() const { return *_impl->image; }
 
 Swapchain::Frame::~Frame() {
     //printf("Recycling frame %d in slot %d\n", id, _impl->slot.image_index);
-    // Before we can cleanup the resources we need to wait on the relevant fences
-    // for now let's just wait on ALL of them at once
-    if (!_impl->cleanup_fences.empty()) {
-        for (auto fence : _impl->cleanup_fences) {
-            //printf("Waited on fence = %llx\n", fence);
-            CHECK_VK_THROW(vkWaitForFences(_impl->device.device, 1, &fence, true, UINT64_MAX));
+    // Before we can cleanup the resources we need to wait on the work that uses them
+    if (_impl->cleanup_ticket > 0) {
+        _impl->device.wait(_impl->cleanup_ticket);
+        _impl->cleanup_ticket = 0;
+    }
+
+    _impl->slot.recycle_command_buffers();
+
+    if (!_impl->command_pools.empty()) {
+        auto& device = _impl->device;
+        std::lock_guard lock(device._impl->command_pools_mutex);
+        for (auto& [thread, pool] : _impl->command_pools) {
+            vkResetCommandPool(device.device, pool, 0);
+            device._impl->spare_command_pools.push_back(pool);
         }
-        _impl->cleanup_fences.clear();
+        _impl->command_pools.clear();
     }
 
     // We want to iterate over the queue in a FIFO manner
@@ -68,11 +78,16 @@ void Swapchain::Frame::queuePresent() {
 
     swapchain._impl->last_present = now;
 
+    // offscreen frames are done once submitted
+    if (swapchain._impl->offscreen)
+        return;
+
     //printf("Presenting in slot: %d\n", slot.image_index);
 
     std::vector<VkSemaphore> semaphores;
     semaphores.push_back(slot.present_semaphore);
 
+    std::unique_lock queue_lock(device._impl->queue_mutex);
     VkResult present_result = vkQueuePresentKHR(device.main_queue, tmpPtr<VkPresentInfoKHR>({
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = static_cast<uint32_t>(semaphores.size()),
@@ -81,6 +96,7 @@ void Swapchain::Frame::queuePresent() {
         .pSwapchains = &swapchain._impl->swapchain.swapchain,
         .pImageIndices = &slot.image_index,
     }));
+    queue_lock.unlock();
     //printf("Queued presentation, will signal %llx\n", (uint64_t) slot.wait_for_previous_present);
     switch (present_result) {
         case VK_SUCCESS:
@@ -95,6 +111,7 @@ void Swapchain::Frame::queuePresent() {
 
 void Swapchain::beginFrame(std::function<void(Swapchain::Frame&)>&& fn) {
     auto& device = _impl->device;
+    device.pollJobs();
     while (true) {
         if (_impl->should_resize) {
             _impl->should_resize = false;
@@ -112,12 +129,18 @@ void Swapchain::beginFrame(std::function<void(Swapchain::Frame&)>&& fn) {
         slot.frame.reset();
         slot.frame = std::make_unique<Frame>(std::move(Frame::Impl(device, slot)));
         slot.frame->swapchain_image_available = acquired;
-        slot.frame->signal_when_ready = slot.present_semaphore;
+        slot.frame->signal_when_ready = _impl->offscreen ? VK_NULL_HANDLE : slot.present_semaphore;
         slot.frame->id = _impl->frame_counter++;
-        assert(acquired);
-        slot.frame->addCleanupAction([=, &device]() {
-            vkDestroySemaphore(device.device, acquired, nullptr);
-        });
+        assert(acquired || _impl->offscreen);
+        if (acquired) {
+            slot.frame->addCleanupAction([=, this, &device, frame = slot.frame.get()]() {
+                // the semaphore is back to unsignalled once the submit waiting on it has retired, which only happened if the frame went through
+                if (frame->_impl->submitted)
+                    _impl->recycle_semaphore(acquired);
+                else
+                    vkDestroySemaphore(device.device, acquired, nullptr);
+            });
+        }
 
         //printf("Preparing frame: %d\n", slot.frame->id);
         fn(*slot.frame);
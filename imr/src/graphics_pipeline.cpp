@@ -1,5 +1,7 @@
 #include "shader_private.h"
 
+#include <algorithm>
+
 namespace imr {
 
 template<typename T>
@@ -9,6 +11,35 @@ T* optional_to_ptr(std::optional<T>& o) {
     return nullptr;
 }
 
+static bool dynamic_state_supported(Device& device, VkDynamicState dynamic_state) {
+    switch (dynamic_state) {
+        case VK_DYNAMIC_STATE_CULL_MODE:
+        case VK_DYNAMIC_STATE_FRONT_FACE:
+        case VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY:
+        case VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE:
+        case VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE:
+        case VK_DYNAMIC_STATE_DEPTH_COMPARE_OP:
+        case VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE:
+        case VK_DYNAMIC_STATE_STENCIL_OP:
+        case VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE:
+        case VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT:
+        case VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT:
+        case VK_DYNAMIC_STATE_VERTEX_INPUT_BINDING_STRIDE:
+        case VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE:
+        case VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE:
+        case VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE:
+            return device.capabilities.extended_dynamic_state;
+        case VK_DYNAMIC_STATE_POLYGON_MODE_EXT:
+        case VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT:
+        case VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT:
+        case VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT:
+            return device.capabilities.extended_dynamic_state3;
+        // the rest of the extended dynamic state isn't negotiated, anything else is core Vulkan 1.0
+        default:
+            return dynamic_state <= VK_DYNAMIC_STATE_STENCIL_REFERENCE;
+    }
+}
+
 GraphicsPipeline::GraphicsPipeline(imr::Device& d, std::vector<ShaderEntryPoint*>&& stages, RenderTargetsState rts, imr::GraphicsPipeline::StateBuilder state) {
     _impl = std::make_unique<Impl>(d, std::move(stages), rts, state);
 }
@@ -25,6 +56,7 @@ GraphicsPipeline::Impl::Impl(Device& device, std::vector<ShaderEntryPoint*>&& st
             .stage = stage->stage(),
             .module = stage->module().vk_shader_module(),
             .pName = stage->name().c_str(),
+            .pSpecializationInfo = stage->_impl->vk_specialization_info(),
         };
         vk_stages.push_back(vk_stage);
         if (!merged_layout)
@@ -33,15 +65,20 @@ GraphicsPipeline::Impl::Impl(Device& device, std::vector<ShaderEntryPoint*>&& st
             merged_layout = ReflectedLayout(*merged_layout, *stage->_impl->reflected);
     }
 
-    layout = std::make_unique<PipelineLayout>(device, *merged_layout);
+    layout = get_pipeline_layout(device, *merged_layout);
     final_layout = *merged_layout;
 
     std::vector<VkDynamicState> dynamic_states = {
         VK_DYNAMIC_STATE_VIEWPORT,
         VK_DYNAMIC_STATE_SCISSOR,
-        //VK_DYNAMIC_STATE_CULL_MODE,
-        //VK_DYNAMIC_STATE_FRONT_FACE,
     };
+    for (auto dynamic_state : state.dynamicStates) {
+        if (std::find(dynamic_states.begin(), dynamic_states.end(), dynamic_state) != dynamic_states.end())
+            continue;
+        if (!dynamic_state_supported(device, dynamic_state))
+            throw std::runtime_error("Dynamic state " + std::to_string(dynamic_state) + " is not supported by this device");
+        dynamic_states.push_back(dynamic_state);
+    }
 
     VkPipelineDynamicStateCreateInfo dynamic_state {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
@@ -94,13 +131,271 @@ GraphicsPipeline::Impl::Impl(Device& device, std::vector<ShaderEntryPoint*>&& st
 
     appendPNext((VkBaseOutStructure*) &pipeline_create_info, (VkBaseOutStructure*) &rendertargets_state);
 
-    CHECK_VK_THROW(vkCreateGraphicsPipelines(device_.device, VK_NULL_HANDLE, 1, &pipeline_create_info, VK_NULL_HANDLE, &pipeline));
+    if (state.fastLink && device.capabilities.graphics_pipeline_library) {
+        pipeline = link_pipeline_libraries(device, layout, stages, pipeline_create_info, rendertargets_state, libraries);
+        return;
+    }
+
+    PipelineCreationFeedback feedback;
+    appendPNext((VkBaseOutStructure*) &pipeline_create_info, (VkBaseOutStructure*) &feedback.info);
+
+    CHECK_VK_THROW(vkCreateGraphicsPipelines(device_.device, device_.pipelineCache(), 1, &pipeline_create_info, VK_NULL_HANDLE, &pipeline));
+    feedback.record(device_);
 }
 
 GraphicsPipeline::Impl::~Impl() {
     vkDestroyPipeline(device_.device, pipeline, VK_NULL_HANDLE);
 }
 
+GraphicsPipelineLibrary::~GraphicsPipelineLibrary() {
+    vkDestroyPipeline(device.device, pipeline, nullptr);
+}
+
+void add_to_key(std::vector<uint8_t>& key, const std::vector<uint8_t>& value) {
+    add_to_key(key, value.size());
+    key.insert(key.end(), value.begin(), value.end());
+}
+
+void add_stage_to_key(std::vector<uint8_t>& key, ShaderEntryPoint& stage, std::vector<std::shared_ptr<ShaderModuleHandle>>& modules) {
+    auto& handle = stage.module()._impl->handle;
+    add_to_key(key, stage.stage());
+    add_to_key(key, reinterpret_cast<uintptr_t>(handle.get()));
+    modules.push_back(handle);
+    add_to_key(key, std::vector<uint8_t>(stage.name().begin(), stage.name().end()));
+    add_to_key(key, stage.specialization().key());
+}
+
+void reject_pnext_in_key(const void* pNext, const char* state) {
+    if (pNext)
+        throw std::runtime_error(std::string("Extension structs in the ") + state + " state can't be part of a pipeline key");
+}
+
+void add_vertex_input_state_to_key(std::vector<uint8_t>& key, const VkPipelineVertexInputStateCreateInfo* vertex_input, const VkPipelineInputAssemblyStateCreateInfo* input_assembly) {
+    add_to_key(key, vertex_input != nullptr);
+    if (vertex_input) {
+        reject_pnext_in_key(vertex_input->pNext, "vertex input");
+        add_to_key(key, vertex_input->vertexBindingDescriptionCount);
+        for (uint32_t i = 0; i < vertex_input->vertexBindingDescriptionCount; i++)
+            add_to_key(key, vertex_input->pVertexBindingDescriptions[i]);
+        add_to_key(key, vertex_input->vertexAttributeDescriptionCount);
+        for (uint32_t i = 0; i < vertex_input->vertexAttributeDescriptionCount; i++)
+            add_to_key(key, vertex_input->pVertexAttributeDescriptions[i]);
+    }
+    add_to_key(key, input_assembly != nullptr);
+    if (input_assembly) {
+        reject_pnext_in_key(input_assembly->pNext, "input assembly");
+        add_to_key(key, input_assembly->topology);
+        add_to_key(key, input_assembly->primitiveRestartEnable);
+    }
+}
+
+void add_pre_rasterization_state_to_key(std::vector<uint8_t>& key, const VkPipelineTessellationStateCreateInfo* tessellation, const VkPipelineViewportStateCreateInfo* viewport, const VkPipelineRasterizationStateCreateInfo* rasterization) {
+    if (tessellation)
+        reject_pnext_in_key(tessellation->pNext, "tessellation");
+    add_to_key(key, tessellation ? tessellation->patchControlPoints : 0u);
+    add_to_key(key, viewport != nullptr);
+    if (viewport) {
+        reject_pnext_in_key(viewport->pNext, "viewport");
+        add_to_key(key, viewport->viewportCount);
+        add_to_key(key, viewport->scissorCount);
+        add_to_key(key, viewport->pViewports != nullptr);
+        for (uint32_t i = 0; viewport->pViewports && i < viewport->viewportCount; i++)
+            add_to_key(key, viewport->pViewports[i]);
+        add_to_key(key, viewport->pScissors != nullptr);
+        for (uint32_t i = 0; viewport->pScissors && i < viewport->scissorCount; i++)
+            add_to_key(key, viewport->pScissors[i]);
+    }
+    add_to_key(key, rasterization != nullptr);
+    if (rasterization) {
+        reject_pnext_in_key(rasterization->pNext, "rasterization");
+        add_to_key(key, rasterization->depthClampEnable);
+        add_to_key(key, rasterization->rasterizerDiscardEnable);
+        add_to_key(key, rasterization->polygonMode);
+        add_to_key(key, rasterization->cullMode);
+        add_to_key(key, rasterization->frontFace);
+        add_to_key(key, rasterization->depthBiasEnable);
+        add_to_key(key, rasterization->depthBiasConstantFactor);
+        add_to_key(key, rasterization->depthBiasClamp);
+        add_to_key(key, rasterization->depthBiasSlopeFactor);
+        add_to_key(key, rasterization->lineWidth);
+    }
+}
+
+void add_multisample_state_to_key(std::vector<uint8_t>& key, const VkPipelineMultisampleStateCreateInfo* multisample) {
+    add_to_key(key, multisample != nullptr);
+    if (!multisample)
+        return;
+    reject_pnext_in_key(multisample->pNext, "multisample");
+    add_to_key(key, multisample->rasterizationSamples);
+    add_to_key(key, multisample->sampleShadingEnable);
+    add_to_key(key, multisample->minSampleShading);
+    add_to_key(key, multisample->pSampleMask ? *multisample->pSampleMask : ~0u);
+    add_to_key(key, multisample->alphaToCoverageEnable);
+    add_to_key(key, multisample->alphaToOneEnable);
+}
+
+static void add_stencil_op_to_key(std::vector<uint8_t>& key, const VkStencilOpState& op) {
+    add_to_key(key, op.failOp);
+    add_to_key(key, op.passOp);
+    add_to_key(key, op.depthFailOp);
+    add_to_key(key, op.compareOp);
+    add_to_key(key, op.compareMask);
+    add_to_key(key, op.writeMask);
+    add_to_key(key, op.reference);
+}
+
+void add_depth_stencil_state_to_key(std::vector<uint8_t>& key, const VkPipelineDepthStencilStateCreateInfo* depth_stencil) {
+    add_to_key(key, depth_stencil != nullptr);
+    if (!depth_stencil)
+        return;
+    reject_pnext_in_key(depth_stencil->pNext, "depth stencil");
+    add_to_key(key, depth_stencil->depthTestEnable);
+    add_to_key(key, depth_stencil->depthWriteEnable);
+    add_to_key(key, depth_stencil->depthCompareOp);
+    add_to_key(key, depth_stencil->depthBoundsTestEnable);
+    add_to_key(key, depth_stencil->stencilTestEnable);
+    add_stencil_op_to_key(key, depth_stencil->front);
+    add_stencil_op_to_key(key, depth_stencil->back);
+    add_to_key(key, depth_stencil->minDepthBounds);
+    add_to_key(key, depth_stencil->maxDepthBounds);
+}
+
+static void add_dynamic_state_to_key(std::vector<uint8_t>& key, const VkGraphicsPipelineCreateInfo& info) {
+    add_to_key(key, info.pDynamicState->dynamicStateCount);
+    for (uint32_t i = 0; i < info.pDynamicState->dynamicStateCount; i++)
+        add_to_key(key, info.pDynamicState->pDynamicStates[i]);
+}
+
+/// Looks the library up in the device's cache, otherwise builds it from `info` (with the subset and the library flag added)
+static std::shared_ptr<GraphicsPipelineLibrary> get_pipeline_library(Device& device, VkGraphicsPipelineLibraryFlagsEXT subset, std::vector<uint8_t> key, std::shared_ptr<PipelineLayout> layout, std::vector<std::shared_ptr<ShaderModuleHandle>> modules, VkGraphicsPipelineCreateInfo info) {
+    key.insert(key.begin(), reinterpret_cast<uint8_t*>(&subset), reinterpret_cast<uint8_t*>(&subset) + sizeof(subset));
+    auto& impl = *device._impl;
+    {
+        std::lock_guard lock(impl.pipeline_libraries_mutex);
+        if (auto existing = impl.pipeline_libraries[key].lock())
+            return existing;
+    }
+
+    // compiling happens outside the lock, PipelineBatch workers shouldn't wait on each other. At worst a library gets built twice.
+    VkGraphicsPipelineLibraryCreateInfoEXT library_info = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .pNext = info.pNext,
+        .flags = subset,
+    };
+    PipelineCreationFeedback feedback;
+    feedback.info.pNext = &library_info;
+    info.pNext = &feedback.info;
+    info.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+
+    auto library = std::make_shared<GraphicsPipelineLibrary>(device, VK_NULL_HANDLE, layout, std::move(modules));
+    CHECK_VK_THROW(vkCreateGraphicsPipelines(device.device, device.pipelineCache(), 1, &info, nullptr, &library->pipeline));
+    feedback.record(device);
+
+    std::lock_guard lock(impl.pipeline_libraries_mutex);
+    auto& cached = impl.pipeline_libraries[key];
+    if (auto existing = cached.lock())
+        return existing;
+    cached = library;
+    return library;
+}
+
+VkPipeline GraphicsPipeline::Impl::link_pipeline_libraries(Device& device, std::shared_ptr<PipelineLayout>& layout, std::vector<ShaderEntryPoint*>& stages, const VkGraphicsPipelineCreateInfo& monolithic, const VkPipelineRenderingCreateInfo& rendering, std::vector<std::shared_ptr<GraphicsPipelineLibrary>>& libraries) {
+    std::vector<VkPipelineShaderStageCreateInfo> pre_rasterization_stages;
+    std::vector<VkPipelineShaderStageCreateInfo> fragment_stages;
+    std::vector<uint8_t> pre_rasterization_key;
+    std::vector<uint8_t> fragment_key;
+    std::vector<std::shared_ptr<ShaderModuleHandle>> pre_rasterization_modules;
+    std::vector<std::shared_ptr<ShaderModuleHandle>> fragment_modules;
+    for (uint32_t i = 0; i < monolithic.stageCount; i++) {
+        bool fragment = monolithic.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+        (fragment ? fragment_stages : pre_rasterization_stages).push_back(monolithic.pStages[i]);
+        add_stage_to_key(fragment ? fragment_key : pre_rasterization_key, *stages[i], fragment ? fragment_modules : pre_rasterization_modules);
+    }
+
+    // Each part only gets the state that belongs to it, and its key only covers that
+    std::vector<uint8_t> vertex_input_key;
+    add_vertex_input_state_to_key(vertex_input_key, monolithic.pVertexInputState, monolithic.pInputAssemblyState);
+    add_dynamic_state_to_key(vertex_input_key, monolithic);
+    libraries.push_back(get_pipeline_library(device, VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, vertex_input_key, nullptr, {}, {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pVertexInputState = monolithic.pVertexInputState,
+        .pInputAssemblyState = monolithic.pInputAssemblyState,
+        .pDynamicState = monolithic.pDynamicState,
+    }));
+
+    add_to_key(pre_rasterization_key, reinterpret_cast<uint64_t>(layout->pipeline_layout));
+    add_to_key(pre_rasterization_key, rendering.viewMask);
+    add_pre_rasterization_state_to_key(pre_rasterization_key, monolithic.pTessellationState, monolithic.pViewportState, monolithic.pRasterizationState);
+    add_dynamic_state_to_key(pre_rasterization_key, monolithic);
+    libraries.push_back(get_pipeline_library(device, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, pre_rasterization_key, layout, std::move(pre_rasterization_modules), {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &rendering,
+        .stageCount = static_cast<uint32_t>(pre_rasterization_stages.size()),
+        .pStages = pre_rasterization_stages.data(),
+        .pTessellationState = monolithic.pTessellationState,
+        .pViewportState = monolithic.pViewportState,
+        .pRasterizationState = monolithic.pRasterizationState,
+        .pDynamicState = monolithic.pDynamicState,
+        .layout = layout->pipeline_layout,
+    }));
+
+    add_to_key(fragment_key, reinterpret_cast<uint64_t>(layout->pipeline_layout));
+    add_to_key(fragment_key, rendering.viewMask);
+    add_multisample_state_to_key(fragment_key, monolithic.pMultisampleState);
+    add_depth_stencil_state_to_key(fragment_key, monolithic.pDepthStencilState);
+    add_dynamic_state_to_key(fragment_key, monolithic);
+    libraries.push_back(get_pipeline_library(device, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, fragment_key, layout, std::move(fragment_modules), {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &rendering,
+        .stageCount = static_cast<uint32_t>(fragment_stages.size()),
+        .pStages = fragment_stages.data(),
+        .pMultisampleState = monolithic.pMultisampleState,
+        .pDepthStencilState = monolithic.pDepthStencilState,
+        .pDynamicState = monolithic.pDynamicState,
+        .layout = layout->pipeline_layout,
+    }));
+
+    std::vector<uint8_t> fragment_output_key;
+    add_to_key(fragment_output_key, rendering.viewMask);
+    for (uint32_t i = 0; i < rendering.colorAttachmentCount; i++)
+        add_to_key(fragment_output_key, rendering.pColorAttachmentFormats[i]);
+    add_to_key(fragment_output_key, rendering.depthAttachmentFormat);
+    add_to_key(fragment_output_key, rendering.stencilAttachmentFormat);
+    add_multisample_state_to_key(fragment_output_key, monolithic.pMultisampleState);
+    if (auto blend = monolithic.pColorBlendState) {
+        reject_pnext_in_key(blend->pNext, "color blend");
+        add_to_key(fragment_output_key, blend->logicOpEnable);
+        add_to_key(fragment_output_key, blend->logicOp);
+        for (uint32_t i = 0; i < blend->attachmentCount; i++)
+            add_to_key(fragment_output_key, blend->pAttachments[i]);
+        add_to_key(fragment_output_key, blend->blendConstants);
+    }
+    add_dynamic_state_to_key(fragment_output_key, monolithic);
+    libraries.push_back(get_pipeline_library(device, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, fragment_output_key, nullptr, {}, {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &rendering,
+        .pMultisampleState = monolithic.pMultisampleState,
+        .pColorBlendState = monolithic.pColorBlendState,
+        .pDynamicState = monolithic.pDynamicState,
+    }));
+
+    // linking without VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT is the cheap part, that's the point of all this
+    std::vector<VkPipeline> handles;
+    for (auto& library : libraries)
+        handles.push_back(library->pipeline);
+    VkPipeline linked;
+    CHECK_VK_THROW(vkCreateGraphicsPipelines(device.device, device.pipelineCache(), 1, tmpPtr<VkGraphicsPipelineCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = tmpPtr<VkPipelineLibraryCreateInfoKHR>({
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+            .libraryCount = static_cast<uint32_t>(handles.size()),
+            .pLibraries = handles.data(),
+        }),
+        .layout = layout->pipeline_layout,
+    }), nullptr, &linked));
+    return linked;
+}
+
 GraphicsPipeline::~GraphicsPipeline() = default;
 
 VkPipelineLayout GraphicsPipeline::layout() const { return _impl->layout->pipeline_layout; }
@@ -163,4 +458,115 @@ VkPipelineDepthStencilStateCreateInfo GraphicsPipeline::simple_depth_testing() {
     return depth_stencil;
 }
 
+std::vector<VkDynamicState> GraphicsPipeline::material_dynamic_states() {
+    return {
+        VK_DYNAMIC_STATE_CULL_MODE,
+        VK_DYNAMIC_STATE_FRONT_FACE,
+        VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+    };
+}
+
+std::vector<VkDynamicState> GraphicsPipeline::blend_dynamic_states() {
+    return {
+        VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
+        VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT,
+        VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT,
+    };
+}
+
+GraphicsPipeline::DynamicStateRecorder::DynamicStateRecorder(Device& device, VkCommandBuffer cmdbuf) : device(device), cmdbuf(cmdbuf) {}
+
+// Extended dynamic state 1 & 2 are core on 1.3 devices, older ones only have the extension's entry points
+#define CORE_OR_EXT(fn) (device.dispatch.fn ? device.dispatch.fn : device.dispatch.fn##EXT)
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::viewport(VkViewport viewport) {
+    vkCmdSetViewport(cmdbuf, 0, 1, &viewport);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::scissor(VkRect2D scissor) {
+    vkCmdSetScissor(cmdbuf, 0, 1, &scissor);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::cull_mode(VkCullModeFlags cull_mode) {
+    CORE_OR_EXT(fp_vkCmdSetCullMode)(cmdbuf, cull_mode);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::front_face(VkFrontFace front_face) {
+    CORE_OR_EXT(fp_vkCmdSetFrontFace)(cmdbuf, front_face);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::primitive_topology(VkPrimitiveTopology topology) {
+    CORE_OR_EXT(fp_vkCmdSetPrimitiveTopology)(cmdbuf, topology);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::depth_test(bool enable) {
+    CORE_OR_EXT(fp_vkCmdSetDepthTestEnable)(cmdbuf, enable);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::depth_write(bool enable) {
+    CORE_OR_EXT(fp_vkCmdSetDepthWriteEnable)(cmdbuf, enable);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::depth_compare_op(VkCompareOp op) {
+    CORE_OR_EXT(fp_vkCmdSetDepthCompareOp)(cmdbuf, op);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::stencil_test(bool enable) {
+    CORE_OR_EXT(fp_vkCmdSetStencilTestEnable)(cmdbuf, enable);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::stencil_op(VkStencilFaceFlags face_mask, VkStencilOp fail_op, VkStencilOp pass_op, VkStencilOp depth_fail_op, VkCompareOp compare_op) {
+    CORE_OR_EXT(fp_vkCmdSetStencilOp)(cmdbuf, face_mask, fail_op, pass_op, depth_fail_op, compare_op);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::depth_bias(bool enable) {
+    CORE_OR_EXT(fp_vkCmdSetDepthBiasEnable)(cmdbuf, enable);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::primitive_restart(bool enable) {
+    CORE_OR_EXT(fp_vkCmdSetPrimitiveRestartEnable)(cmdbuf, enable);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::rasterizer_discard(bool enable) {
+    CORE_OR_EXT(fp_vkCmdSetRasterizerDiscardEnable)(cmdbuf, enable);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::polygon_mode(VkPolygonMode mode) {
+    device.dispatch.cmdSetPolygonModeEXT(cmdbuf, mode);
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::blend_enable(std::vector<VkBool32> enable, uint32_t first_attachment) {
+    device.dispatch.cmdSetColorBlendEnableEXT(cmdbuf, first_attachment, enable.size(), enable.data());
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::blend_equation(std::vector<VkColorBlendEquationEXT> equations, uint32_t first_attachment) {
+    device.dispatch.cmdSetColorBlendEquationEXT(cmdbuf, first_attachment, equations.size(), equations.data());
+    return *this;
+}
+
+GraphicsPipeline::DynamicStateRecorder& GraphicsPipeline::DynamicStateRecorder::color_write_mask(std::vector<VkColorComponentFlags> masks, uint32_t first_attachment) {
+    device.dispatch.cmdSetColorWriteMaskEXT(cmdbuf, first_attachment, masks.size(), masks.data());
+    return *this;
+}
+
+#undef CORE_OR_EXT
+
 }
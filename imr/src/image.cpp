@@ -370,6 +370,7 @@ Image::~Image() {
     if (_impl) {
         if (_impl->vma_allocation)
             vmaDestroyImage(_impl->device._impl->allocator, _impl->handle, _impl->vma_allocation.value());
+        forget_launch_binding(_impl->device, _impl->view);
         vkDestroyImageView(_impl->device.device, _impl->view, nullptr);
     }
 }
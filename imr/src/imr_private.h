@@ -7,13 +7,225 @@
 
 #define CHECK_VK_THROW(do) CHECK_VK(do, throw std::runtime_error(#do))
 
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
 namespace imr {
 
+struct ReflectedLayout;
+struct ShaderModuleHandle;
+struct DescriptorSetLayout;
+struct PipelineLayout;
+struct GraphicsPipelineLibrary;
+struct LaunchCache;
+
+/// The ticket a command buffer's current recording was submitted with, 0 until queue_submit() gets to it.
+/// Lets things used by commands being recorded outlive them without knowing which frame or job they belong to.
+struct RecordingTicket {
+    std::atomic<uint64_t> ticket = 0;
+};
+
+/// The hash the reflection cache is keyed by could collide, entries only count when the module's size and a second hash match as well
+struct ReflectionCacheEntry {
+    uint32_t spirv_words;
+    uint64_t check;
+    std::shared_ptr<const ReflectedLayout> reflected;
+    /// Value of Device::Impl::reflection_clock when this run last used the entry, 0 if it only came from the file
+    uint64_t last_used = 0;
+};
+
+/// Persistently mapped, host-visible buffer that uploads are staged through.
+/// Space is handed out linearly and only gets reused once every allocation made before it was released.
+struct StagingRing {
+    static constexpr uint64_t default_size = 16 * 1024 * 1024;
+
+    struct Allocation {
+        uint64_t offset;
+        void* mapped;
+        /// end of the allocation in the (ever-increasing) ring address space, identifies it for release()
+        uint64_t end;
+    };
+
+    StagingRing(Device&, uint64_t size);
+    StagingRing(StagingRing&) = delete;
+    ~StagingRing();
+
+    /// Returns std::nullopt if there is not enough free space, either because the ring is too small or because older allocations are still in flight
+    std::optional<Allocation> allocate(uint64_t size, uint64_t alignment = 16);
+    void release(const Allocation&);
+
+    Device& device;
+    uint64_t const size;
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    uint8_t* mapped;
+
+private:
+    struct Range {
+        uint64_t start;
+        uint64_t end;
+        bool released;
+    };
+
+    /// Uploads can be staged from any thread
+    std::mutex mutex;
+    uint64_t head = 0;
+    std::deque<Range> in_flight;
+};
+
+/// Big descriptor pools that every DescriptorBindHelper allocates its sets from, instead of creating a pool of its own.
+/// Sets are carved out of the current pool until it's full, then it's retired. Helpers live as long as their frame, so once the last one holding sets
+/// from a retired pool is gone, the frames that used it are too: the pool gets reset in one go and goes back into rotation.
+/// That only works for sets that live as long as a frame, one kept for longer would hold back its whole pool: LaunchCache has pools of its own.
+struct DescriptorPoolRing {
+    static constexpr uint32_t sets_per_pool = 1024;
+    static constexpr uint32_t descriptors_per_type = 4096;
+    /// Layouts with other descriptor types (or more than descriptors_per_type of one in a set) need a pool of their own
+    bool serves(VkDescriptorType) const;
+
+    DescriptorPoolRing(Device&);
+    DescriptorPoolRing(DescriptorPoolRing&) = delete;
+    ~DescriptorPoolRing();
+
+    /// Returns the pool the set came from, each set has to be given back with release(pool) once it's no longer in use
+    VkDescriptorPool allocate(VkDescriptorSetLayout, VkDescriptorSet&);
+    void release(VkDescriptorPool);
+
+    Device& device;
+
+private:
+    VkDescriptorPool create_pool();
+
+    /// Acceleration structure descriptors only exist when the device has the extension enabled
+    bool acceleration_structures;
+
+    std::mutex mutex;
+    VkDescriptorPool current = VK_NULL_HANDLE;
+    /// Sets still in use, per pool. Retired pools leave this (and get reset) when they reach 0.
+    std::unordered_map<VkDescriptorPool, uint32_t> live_sets;
+    std::vector<VkDescriptorPool> spare;
+};
+
+/// Outlives the device for the threads that have a command pool from it, so they can tell whether there's still something to give the pools back to
+struct CommandPoolsOwner {
+    std::mutex mutex;
+    /// Cleared first thing when the device gets destroyed
+    Device* device;
+};
+
+/// A batch of async jobs sharing one command buffer, every Job recorded into it points here
+struct Device::Job::Impl {
+    static constexpr size_t max_jobs_per_batch = 256;
+
+    Device& device;
+    VkCommandBuffer cmdbuf;
+    size_t jobs = 0;
+    /// 0 while the batch is still being recorded
+    uint64_t ticket = 0;
+    bool retired = false;
+    std::vector<std::function<void()>> callbacks;
+};
+
 struct Device::Impl {
     VmaAllocator allocator;
 
     //std::vector<std::unique_ptr<Buffer>> buffers;
     std::vector<std::unique_ptr<Image>> images;
+
+    /// Lazily created by the first upload that needs it
+    std::unique_ptr<StagingRing> staging_ring;
+    std::once_flag staging_ring_created;
+    /// Same for the descriptor pools
+    std::unique_ptr<DescriptorPoolRing> descriptor_pools;
+    std::once_flag descriptor_pools_created;
+
+    /// Signalled by every submit(), the value is the ticket of the last one to complete
+    VkSemaphore timeline;
+    uint64_t last_ticket = 0;
+    /// Ticket of the last async job batch, and the newest one a submit() has waited on so far (both guarded by queue_mutex)
+    uint64_t submitted_jobs_ticket = 0;
+    uint64_t waited_jobs_ticket = 0;
+    /// Recordings someone is waiting to see submitted, see recording_ticket() (guarded by queue_mutex)
+    std::unordered_map<VkCommandBuffer, std::shared_ptr<RecordingTicket>> recording_tickets;
+    /// Queues are externally synchronized too, this guards submissions and presentation
+    std::mutex queue_mutex;
+
+    /// Guards all the command pool bookkeeping below (and the frames' lists of borrowed pools)
+    std::mutex command_pools_mutex;
+    std::map<std::tuple<std::thread::id, uint32_t>, VkCommandPool> thread_command_pools;
+    std::shared_ptr<CommandPoolsOwner> command_pools_owner;
+    /// Pools frames have given back after resetting them, ready to be lent out again
+    std::vector<VkCommandPool> spare_command_pools;
+
+    /// Guards the async job batches, the pending one is also recorded under it
+    std::mutex jobs_mutex;
+    VkCommandPool jobs_pool = VK_NULL_HANDLE;
+    std::shared_ptr<Device::Job::Impl> pending_jobs;
+    std::deque<std::shared_ptr<Device::Job::Impl>> submitted_jobs;
+    uint64_t last_jobs_ticket = 0;
+
+    /// Every pipeline gets created through this, it's loaded from and saved to `pipeline_cache_path`
+    VkPipelineCache pipeline_cache;
+    std::filesystem::path pipeline_cache_path;
+    std::atomic<uint32_t> pipeline_cache_hits = 0;
+    std::atomic<uint32_t> pipeline_cache_misses = 0;
+
+    /// Guards the two shader caches below
+    std::mutex shader_cache_mutex;
+    /// Identical SPIR-V shares one VkShaderModule, keyed by hash_spirv()
+    std::unordered_map<uint64_t, std::weak_ptr<ShaderModuleHandle>> shader_modules;
+    /// Reflection doesn't depend on the stage, so this is keyed by hash_spirv() alone (entries double-check the module) and the stage gets filled in afterwards
+    std::unordered_map<uint64_t, ReflectionCacheEntry> reflection_cache;
+    bool reflection_cache_dirty = false;
+    uint64_t reflection_clock = 0;
+
+    /// Guards the layout caches: set layouts are keyed by their sorted bindings, pipeline layouts by their set layouts and push constant ranges
+    std::mutex layouts_mutex;
+    std::map<std::vector<uint32_t>, std::weak_ptr<DescriptorSetLayout>> descriptor_set_layouts;
+    std::map<std::vector<uint64_t>, std::weak_ptr<PipelineLayout>> pipeline_layouts;
+
+    /// Graphics pipeline parts, keyed by the subset they implement and the state that goes into it
+    std::mutex pipeline_libraries_mutex;
+    std::map<std::vector<uint8_t>, std::weak_ptr<GraphicsPipelineLibrary>> pipeline_libraries;
+
+    /// Every compute pipeline's launch cache, so destroying a resource can drop the sets that refer to it
+    std::mutex launch_caches_mutex;
+    std::set<LaunchCache*> launch_caches;
+};
+
+/// $IMR_CACHE_DIR if set, otherwise the usual per-user cache directory
+std::filesystem::path cache_directory();
+/// Writes the file atomically, reports failures but doesn't throw
+bool write_cache_file(const std::filesystem::path&, const void* data, size_t size);
+/// Process id and a random number, for files that concurrent writers must not share
+std::string unique_file_suffix();
+
+void create_pipeline_cache(Device&);
+/// Also saves it
+void destroy_pipeline_cache(Device&);
+
+/// The reflection cache lives next to the pipeline cache
+/// The RecordingTicket of what is currently being recorded into `cmdbuf`, resolved when a submission includes it.
+/// Secondary command buffers never are, whatever waits on theirs keeps waiting.
+std::shared_ptr<RecordingTicket> recording_ticket(Device&, VkCommandBuffer cmdbuf);
+void load_reflection_cache(Device&);
+void save_reflection_cache(Device&);
+
+/// Chain `info` into a pipeline create info, then record() whether the pipeline cache had it once it's created
+struct PipelineCreationFeedback {
+    VkPipelineCreationFeedback feedback = {};
+    VkPipelineCreationFeedbackCreateInfo info;
+
+    PipelineCreationFeedback();
+    PipelineCreationFeedback(const PipelineCreationFeedback&) = delete;
+    void record(Device&);
 };
 
 static inline void appendPNext(VkBaseOutStructure* base, VkBaseOutStructure* ext) {
@@ -23,6 +235,10 @@ static inline void appendPNext(VkBaseOutStructure* base, VkBaseOutStructure* ext
     base->pNext = ext;
 }
 
+VkCommandPool create_command_pool(Device&, uint32_t queue_family);
+
+DescriptorPoolRing& get_descriptor_pools(Device&);
+
 Image make_image_from(Device& device, VkImage existing_handle, VkImageType dim, VkExtent3D size, VkFormat format);
 
 }
@@ -0,0 +1,267 @@
+#include "shader_private.h"
+
+#include <algorithm>
+
+namespace imr {
+
+namespace bind {
+    LaunchBinding storage_image(uint32_t set, uint32_t binding, VkImageView view, uint32_t array_element) {
+        assert(view != VK_NULL_HANDLE);
+        return { .set = set, .binding = binding, .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .array_element = array_element, .image_view = view };
+    }
+
+    LaunchBinding sampler(uint32_t set, uint32_t binding, VkSampler sampler, uint32_t array_element) {
+        return { .set = set, .binding = binding, .type = VK_DESCRIPTOR_TYPE_SAMPLER, .array_element = array_element, .sampler = sampler };
+    }
+
+    LaunchBinding texture_image(uint32_t set, uint32_t binding, VkImageView view, uint32_t array_element) {
+        return { .set = set, .binding = binding, .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .array_element = array_element, .image_view = view };
+    }
+
+    LaunchBinding uniform_buffer(uint32_t set, uint32_t binding, Buffer& buffer, uint64_t offset) {
+        return { .set = set, .binding = binding, .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .buffer = buffer.handle, .offset = offset, .range = buffer.size };
+    }
+
+    LaunchBinding storage_buffer(uint32_t set, uint32_t binding, Buffer& buffer, uint64_t offset) {
+        return { .set = set, .binding = binding, .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .buffer = buffer.handle, .offset = offset, .range = buffer.size };
+    }
+
+    LaunchBinding acceleration_structure(uint32_t set, uint32_t binding, AccelerationStructure& as) {
+        return { .set = set, .binding = binding, .type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, .acceleration_structure = as.handle() };
+    }
+}
+
+LaunchCache::LaunchCache(Device& device, PipelineLayout& layout, const ReflectedLayout& reflected) : device(device), layout(layout), reflected(reflected) {
+    if (!reflected.push_constants.empty()) {
+        push_constants_begin = UINT32_MAX;
+        for (auto& range : reflected.push_constants) {
+            push_constants_begin = std::min(push_constants_begin, range.offset);
+            push_constants_end = std::max(push_constants_end, range.offset + range.size);
+        }
+    }
+
+    std::lock_guard lock(device._impl->launch_caches_mutex);
+    device._impl->launch_caches.insert(this);
+}
+
+LaunchCache::~LaunchCache() {
+    {
+        std::lock_guard lock(device._impl->launch_caches_mutex);
+        device._impl->launch_caches.erase(this);
+    }
+    // the pipeline can't be in use anymore, and neither can its sets
+    for (auto pool : pools)
+        vkDestroyDescriptorPool(device.device, pool, nullptr);
+}
+
+VkDescriptorPool LaunchCache::allocate(uint32_t set, VkDescriptorSet& descriptor_set) {
+    auto allocate = [&](VkDescriptorPool pool) {
+        return vkAllocateDescriptorSets(device.device, tmpPtr<VkDescriptorSetAllocateInfo>({
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &layout.set_layouts[set],
+        }), &descriptor_set);
+    };
+    for (auto pool = pools.rbegin(); pool != pools.rend(); pool++) {
+        if (allocate(*pool) == VK_SUCCESS)
+            return *pool;
+    }
+
+    // sized for sets_per_pool of the pipeline's biggest set, whichever sets get used
+    std::unordered_map<VkDescriptorType, uint32_t> descriptor_counts;
+    for (auto& [set, set_bindings] : reflected.set_bindings) {
+        std::unordered_map<VkDescriptorType, uint32_t> set_counts;
+        for (auto& binding : set_bindings)
+            set_counts[binding.descriptorType] += binding.descriptorCount;
+        for (auto& [type, count] : set_counts)
+            descriptor_counts[type] = std::max(descriptor_counts[type], count);
+    }
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (auto& [type, count] : descriptor_counts)
+        pool_sizes.push_back({ .type = type, .descriptorCount = count * sets_per_pool });
+
+    VkDescriptorPool pool;
+    CHECK_VK_THROW(vkCreateDescriptorPool(device.device, tmpPtr<VkDescriptorPoolCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = sets_per_pool,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data(),
+    }), nullptr, &pool));
+    pools.push_back(pool);
+    CHECK_VK_THROW(allocate(pool));
+    return pool;
+}
+
+bool LaunchCache::done(std::vector<std::shared_ptr<RecordingTicket>>& recordings) {
+    // an unsubmitted recording (ticket 0) may still bind the set in commands nobody has seen yet
+    std::erase_if(recordings, [&](auto& recording) {
+        uint64_t ticket = recording->ticket;
+        return ticket != 0 && device.is_done(ticket);
+    });
+    return recordings.empty();
+}
+
+void LaunchCache::retire(std::map<std::vector<uint8_t>, Entry>::iterator found) {
+    lru.erase(found->second.lru_position);
+    retired.push_back(std::move(found->second));
+    sets.erase(found);
+}
+
+void LaunchCache::free_retired() {
+    std::erase_if(retired, [&](Entry& entry) {
+        if (!done(entry.recordings))
+            return false;
+        vkFreeDescriptorSets(device.device, entry.pool, 1, &entry.set);
+        return true;
+    });
+}
+
+VkDescriptorSet LaunchCache::get(VkCommandBuffer cmdbuf, uint32_t set, const std::vector<const LaunchBinding*>& bindings) {
+    std::vector<uint8_t> key;
+    add_to_key(key, set);
+    for (auto binding : bindings) {
+        add_to_key(key, binding->binding);
+        add_to_key(key, binding->type);
+        add_to_key(key, binding->array_element);
+        add_to_key(key, binding->image_view);
+        add_to_key(key, binding->sampler);
+        add_to_key(key, binding->buffer);
+        add_to_key(key, binding->acceleration_structure);
+        add_to_key(key, binding->offset);
+        add_to_key(key, binding->range);
+    }
+    auto recording = recording_ticket(device, cmdbuf);
+
+    std::lock_guard lock(mutex);
+    free_retired();
+    auto remember = [&](Entry& entry) {
+        done(entry.recordings);
+        if (std::find(entry.recordings.begin(), entry.recordings.end(), recording) == entry.recordings.end())
+            entry.recordings.push_back(recording);
+    };
+    if (auto found = sets.find(key); found != sets.end()) {
+        auto& entry = found->second;
+        remember(entry);
+        lru.splice(lru.end(), lru, entry.lru_position);
+        return entry.set;
+    }
+
+    Entry entry = {};
+    entry.pool = allocate(set, entry.set);
+    remember(entry);
+    std::vector<VkDescriptorImageInfo> image_infos;
+    std::vector<VkDescriptorBufferInfo> buffer_infos;
+    std::vector<VkWriteDescriptorSetAccelerationStructureKHR> as_infos;
+    // the writes point into these
+    image_infos.reserve(bindings.size());
+    buffer_infos.reserve(bindings.size());
+    as_infos.reserve(bindings.size());
+    std::vector<VkWriteDescriptorSet> writes;
+    for (auto binding : bindings) {
+        VkWriteDescriptorSet write = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = entry.set,
+            .dstBinding = binding->binding,
+            .dstArrayElement = binding->array_element,
+            .descriptorCount = 1,
+            .descriptorType = binding->type,
+        };
+        switch (binding->type) {
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+                write.pImageInfo = &image_infos.emplace_back(VkDescriptorImageInfo {
+                    .sampler = binding->sampler,
+                    .imageView = binding->image_view,
+                    .imageLayout = binding->image_view ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED,
+                });
+                entry.handles.push_back(binding->image_view ? (uint64_t) binding->image_view : (uint64_t) binding->sampler);
+                break;
+            case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+                write.pBufferInfo = &buffer_infos.emplace_back(VkDescriptorBufferInfo {
+                    .buffer = binding->buffer,
+                    .offset = binding->offset,
+                    .range = binding->range,
+                });
+                entry.handles.push_back((uint64_t) binding->buffer);
+                break;
+            case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+                write.pNext = &as_infos.emplace_back(VkWriteDescriptorSetAccelerationStructureKHR {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+                    .accelerationStructureCount = 1,
+                    .pAccelerationStructures = &binding->acceleration_structure,
+                });
+                entry.handles.push_back((uint64_t) binding->acceleration_structure);
+                break;
+            default:
+                throw std::runtime_error("Unsupported descriptor type for a launch binding");
+        }
+        writes.push_back(write);
+    }
+    vkUpdateDescriptorSets(device.device, writes.size(), writes.data(), 0, nullptr);
+
+    auto inserted = sets.emplace(std::move(key), std::move(entry)).first;
+    inserted->second.lru_position = lru.insert(lru.end(), &inserted->first);
+    VkDescriptorSet descriptor_set = inserted->second.set;
+    // the new set is the most recently used one, it's never retired here
+    while (sets.size() > max_sets)
+        retire(sets.find(*lru.front()));
+    return descriptor_set;
+}
+
+void LaunchCache::forget(uint64_t handle) {
+    std::lock_guard lock(mutex);
+    for (auto found = sets.begin(); found != sets.end();) {
+        auto& handles = found->second.handles;
+        auto next = std::next(found);
+        if (std::find(handles.begin(), handles.end(), handle) != handles.end())
+            retire(found);
+        found = next;
+    }
+    free_retired();
+}
+
+void forget_launch_binding(Device& device, uint64_t handle) {
+    std::lock_guard lock(device._impl->launch_caches_mutex);
+    for (auto cache : device._impl->launch_caches)
+        cache->forget(handle);
+}
+
+VkExtent3D ComputePipeline::groups_for_extent(VkExtent3D extent) const {
+    auto& local_size = _impl->local_size;
+    return { (extent.width + local_size.width - 1) / local_size.width, (extent.height + local_size.height - 1) / local_size.height, (extent.depth + local_size.depth - 1) / local_size.depth };
+}
+
+void ComputePipeline::launch(VkCommandBuffer cmdbuf, VkExtent3D groups, const void* push_constants, size_t push_constants_size, size_t push_constants_alignment, std::initializer_list<LaunchBinding> bindings) {
+    auto& cache = *_impl->launch_cache;
+
+    // C++ rounds the struct's size up to its alignment, the shader's block doesn't have to end there
+    size_t end = cache.push_constants_end;
+    if (push_constants_size < end || push_constants_size - end >= push_constants_alignment)
+        throw std::runtime_error("The push constants passed to launch() are " + std::to_string(push_constants_size) + " bytes, the shader expects " + std::to_string(end));
+
+    std::map<uint32_t, std::vector<const LaunchBinding*>> by_set;
+    for (auto& binding : bindings) {
+        auto reflected = cache.reflected.find_binding(binding.set, binding.binding);
+        // like DescriptorBindHelper, bindings the shader doesn't use are ignored
+        if (!reflected)
+            continue;
+        if (reflected->descriptorType != binding.type)
+            throw std::runtime_error("launch() got the wrong kind of resource for set " + std::to_string(binding.set) + ", binding " + std::to_string(binding.binding));
+        by_set[binding.set].push_back(&binding);
+    }
+
+    vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, _impl->pipeline);
+    for (auto& [set, set_bindings] : by_set) {
+        VkDescriptorSet descriptor_set = cache.get(cmdbuf, set, set_bindings);
+        vkCmdBindDescriptorSets(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, _impl->layout->pipeline_layout, set, 1, &descriptor_set, 0, nullptr);
+    }
+    if (end > 0)
+        vkCmdPushConstants(cmdbuf, _impl->layout->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, cache.push_constants_begin, end - cache.push_constants_begin, static_cast<const uint8_t*>(push_constants) + cache.push_constants_begin);
+    vkCmdDispatch(cmdbuf, groups.width, groups.height, groups.depth);
+}
+
+}
@@ -0,0 +1,54 @@
+#include "imr_private.h"
+
+#include <algorithm>
+
+namespace imr {
+
+PipelineBatch::PipelineBatch(Device& device) : device(device) {}
+
+std::future<std::unique_ptr<ComputePipeline>> PipelineBatch::add_compute(std::string spirv_filename, std::string entrypoint_name, SpecializationConstants specialization) {
+    return add<ComputePipeline>([=](Device& device) mutable {
+        return std::make_unique<ComputePipeline>(device, std::move(spirv_filename), std::move(entrypoint_name), std::move(specialization));
+    });
+}
+
+std::future<std::unique_ptr<GraphicsPipeline>> PipelineBatch::add_graphics(std::vector<Stage> stages, GraphicsPipeline::RenderTargetsState render_targets, GraphicsPipeline::StateBuilder state) {
+    return add<GraphicsPipeline>([=](Device& device) {
+        std::vector<std::unique_ptr<ShaderModule>> modules;
+        std::vector<std::unique_ptr<ShaderEntryPoint>> entry_points;
+        std::vector<ShaderEntryPoint*> entry_point_ptrs;
+        for (auto& stage : stages) {
+            modules.push_back(std::make_unique<ShaderModule>(device, std::string(stage.spirv_filename)));
+            entry_points.push_back(std::make_unique<ShaderEntryPoint>(*modules.back(), stage.stage, stage.entrypoint_name, stage.specialization));
+            entry_point_ptrs.push_back(entry_points.back().get());
+        }
+        return std::make_unique<GraphicsPipeline>(device, std::move(entry_point_ptrs), render_targets, state);
+    });
+}
+
+void PipelineBatch::build(unsigned threads) {
+    auto batch = std::move(tasks);
+    tasks.clear();
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, static_cast<unsigned>(batch.size()));
+
+    // file I/O, reflection and the driver's compiler all run on the workers, the pipeline cache is internally synchronized
+    std::atomic<size_t> next = 0;
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back([&]() {
+            for (size_t task = next++; task < batch.size(); task = next++)
+                batch[task](device);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+}
+
+PipelineBatch::~PipelineBatch() {
+    build();
+}
+
+}
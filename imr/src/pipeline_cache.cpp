@@ -0,0 +1,144 @@
+#include "imr_private.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace imr {
+
+std::filesystem::path cache_directory() {
+    if (auto dir = getenv("IMR_CACHE_DIR"))
+        return dir;
+    if (auto xdg = getenv("XDG_CACHE_HOME"))
+        return std::filesystem::path(xdg) / "imr";
+    if (auto home = getenv("HOME"))
+        return std::filesystem::path(home) / ".cache" / "imr";
+    return std::filesystem::temp_directory_path() / "imr";
+}
+
+/// The driver would reject a foreign cache anyway, but keying the file on the device and driver means several GPUs or driver updates don't keep overwriting each other's cache
+static std::filesystem::path pipeline_cache_path(Device& device) {
+    auto& properties = device.physical_device.properties;
+    char name[128];
+    snprintf(name, sizeof(name), "pipelines-%04x-%04x-%08x-", properties.vendorID, properties.deviceID, properties.driverVersion);
+    std::string filename = name;
+    for (auto byte : properties.pipelineCacheUUID) {
+        snprintf(name, sizeof(name), "%02x", byte);
+        filename += name;
+    }
+    return cache_directory() / (filename + ".bin");
+}
+
+static std::vector<char> read_cache_file(Device& device, const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return {};
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // Don't hand a truncated or mismatched file to the driver, not all of them are robust against that
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header))
+        return {};
+    memcpy(&header, data.data(), sizeof(header));
+    auto& properties = device.physical_device.properties;
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header.vendorID != properties.vendorID || header.deviceID != properties.deviceID || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+        return {};
+    return data;
+}
+
+void create_pipeline_cache(Device& device) {
+    auto& impl = *device._impl;
+    impl.pipeline_cache_path = pipeline_cache_path(device);
+    auto data = read_cache_file(device, impl.pipeline_cache_path);
+
+    CHECK_VK_THROW(vkCreatePipelineCache(device.device, tmpPtr<VkPipelineCacheCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data.size(),
+        .pInitialData = data.empty() ? nullptr : data.data(),
+    }), nullptr, &impl.pipeline_cache));
+}
+
+void Device::savePipelineCache() {
+    size_t size;
+    CHECK_VK_THROW(vkGetPipelineCacheData(device, _impl->pipeline_cache, &size, nullptr));
+    std::vector<char> data(size);
+    CHECK_VK_THROW(vkGetPipelineCacheData(device, _impl->pipeline_cache, &size, data.data()));
+
+    write_cache_file(_impl->pipeline_cache_path, data.data(), size);
+}
+
+std::string unique_file_suffix() {
+    return std::to_string(getpid()) + "-" + std::to_string(std::random_device()());
+}
+
+bool write_cache_file(const std::filesystem::path& path, const void* data, size_t size) {
+    // write to the side and swap it in, so a crash or another instance never leaves a half-written cache behind.
+    // Every writer gets its own file, threads and processes racing to write the same cache must not write into each other's.
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    auto tmp_path = path;
+    tmp_path += "." + unique_file_suffix() + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(data), size)) {
+            fprintf(stderr, "Failed to write %s\n", tmp_path.c_str());
+            file.close();
+            std::filesystem::remove(tmp_path, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp_path, path, error);
+    if (error) {
+        std::error_code ignored;
+        std::filesystem::remove(tmp_path, ignored);
+        fprintf(stderr, "Failed to write %s: %s\n", path.c_str(), error.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+void destroy_pipeline_cache(Device& device) {
+    // this runs in the device destructor, losing the cache isn't worth crashing over
+    try {
+        device.savePipelineCache();
+    } catch (std::exception& e) {
+        fprintf(stderr, "Failed to save the pipeline cache: %s\n", e.what());
+    }
+    vkDestroyPipelineCache(device.device, device._impl->pipeline_cache, nullptr);
+}
+
+VkPipelineCache Device::pipelineCache() const { return _impl->pipeline_cache; }
+
+Device::PipelineCacheStats Device::pipelineCacheStats() const {
+    return {
+        .hits = _impl->pipeline_cache_hits,
+        .misses = _impl->pipeline_cache_misses,
+    };
+}
+
+PipelineCreationFeedback::PipelineCreationFeedback() {
+    info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pPipelineCreationFeedback = &feedback,
+    };
+}
+
+void PipelineCreationFeedback::record(Device& device) {
+    // drivers are free not to report anything
+    if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT))
+        return;
+    if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+        device._impl->pipeline_cache_hits++;
+    else
+        device._impl->pipeline_cache_misses++;
+}
+
+}
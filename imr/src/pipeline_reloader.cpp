@@ -0,0 +1,209 @@
+#include "shader_private.h"
+
+#include <condition_variable>
+#include <set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace imr {
+
+struct PipelineReloader::Impl {
+    Device& device;
+    std::vector<std::filesystem::path> paths;
+    std::function<std::shared_ptr<void>(Device&)> build;
+
+    std::mutex mutex;
+    std::condition_variable first_built;
+    /// Only ever replaced by update(), on the thread rendering with it
+    std::shared_ptr<void> current;
+    std::exception_ptr first_error;
+    /// Latest successful rebuild, not swapped in yet
+    std::shared_ptr<void> pending;
+    /// Swapped out pipelines, along with the ticket after which nothing uses them anymore
+    std::vector<std::tuple<uint64_t, std::shared_ptr<void>>> retired;
+
+    std::atomic<bool> stop = false;
+#ifdef __linux__
+    int inotify = -1;
+    /// Written to in order to wake the watcher up for shutting down
+    int wake[2] = { -1, -1 };
+#endif
+    std::thread watcher;
+
+    Impl(Device&, std::vector<std::string>&& spirv_filenames, std::function<std::shared_ptr<void>(Device&)>&& build);
+    ~Impl();
+
+    void rebuild();
+    void watch();
+};
+
+/// Everything recorded so far is covered by this ticket, as long as it has been submitted
+static uint64_t last_submitted_ticket(Device& device) {
+    device.flushJobs();
+    std::lock_guard lock(device._impl->queue_mutex);
+    return device._impl->last_ticket;
+}
+
+PipelineReloader::Impl::Impl(Device& device, std::vector<std::string>&& spirv_filenames, std::function<std::shared_ptr<void>(Device&)>&& build) : device(device), build(std::move(build)) {
+    for (auto& filename : spirv_filenames)
+        paths.push_back(spirv_module_path(filename));
+
+#ifdef __linux__
+    // compilers tend to replace files rather than write them in place, so the directories are watched rather than the files themselves
+    inotify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify < 0 || pipe(wake) != 0)
+        throw std::runtime_error("Failed to set up the shader watcher");
+    std::set<std::filesystem::path> directories;
+    for (auto& path : paths)
+        directories.insert(path.parent_path());
+    for (auto& directory : directories)
+        inotify_add_watch(inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+#endif
+
+    watcher = std::thread([this]() {
+        rebuild();
+        watch();
+    });
+}
+
+void PipelineReloader::Impl::rebuild() {
+    try {
+        auto pipeline = build(device);
+        std::lock_guard lock(mutex);
+        if (!current) {
+            current = std::move(pipeline);
+            first_built.notify_all();
+        } else {
+            pending = std::move(pipeline);
+        }
+    } catch (std::exception& e) {
+        std::lock_guard lock(mutex);
+        fprintf(stderr, "Failed to rebuild the pipeline for %s: %s\n", paths.front().c_str(), e.what());
+        if (!current) {
+            first_error = std::current_exception();
+            first_built.notify_all();
+        }
+    }
+}
+
+void PipelineReloader::Impl::watch() {
+#ifdef __linux__
+    while (!stop) {
+        pollfd fds[2] = {
+            { .fd = inotify, .events = POLLIN },
+            { .fd = wake[0], .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) < 0 || fds[1].revents)
+            continue;
+
+        bool changed = false;
+        auto check_events = [&]() {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t size;
+            while ((size = read(inotify, buffer, sizeof(buffer))) > 0) {
+                for (char* ptr = buffer; ptr < buffer + size;) {
+                    auto event = reinterpret_cast<inotify_event*>(ptr);
+                    for (auto& path : paths) {
+                        if (event->len > 0 && path.filename() == event->name)
+                            changed = true;
+                    }
+                    ptr += sizeof(inotify_event) + event->len;
+                }
+            }
+        };
+        check_events();
+        if (!changed)
+            continue;
+        // several files usually get written in quick succession, wait for things to settle
+        do {
+            changed = false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            check_events();
+        } while (changed && !stop);
+        if (!stop)
+            rebuild();
+    }
+#else
+    // no inotify, fall back to polling the modification times
+    auto timestamps = [&]() {
+        std::vector<std::filesystem::file_time_type> times;
+        for (auto& path : paths) {
+            std::error_code error;
+            times.push_back(std::filesystem::last_write_time(path, error));
+        }
+        return times;
+    };
+    auto last = timestamps();
+    while (!stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        auto now = timestamps();
+        if (now != last) {
+            last = now;
+            rebuild();
+        }
+    }
+#endif
+}
+
+PipelineReloader::Impl::~Impl() {
+    stop = true;
+#ifdef __linux__
+    if (wake[1] >= 0) {
+        char byte = 0;
+        (void) !write(wake[1], &byte, 1);
+    }
+#endif
+    if (watcher.joinable())
+        watcher.join();
+#ifdef __linux__
+    if (inotify >= 0)
+        close(inotify);
+    for (int fd : wake) {
+        if (fd >= 0)
+            close(fd);
+    }
+#endif
+
+    // frames in flight might still use any of them
+    device.wait(last_submitted_ticket(device));
+}
+
+PipelineReloader::PipelineReloader(Device& device, std::vector<std::string> spirv_filenames, std::function<std::shared_ptr<void>(Device&)> build) {
+    _impl = std::make_unique<Impl>(device, std::move(spirv_filenames), std::move(build));
+}
+
+void* PipelineReloader::get() const {
+    std::unique_lock lock(_impl->mutex);
+    if (!_impl->current) {
+        _impl->first_built.wait(lock, [&]() { return _impl->current || _impl->first_error; });
+        if (!_impl->current)
+            std::rethrow_exception(_impl->first_error);
+    }
+    return _impl->current.get();
+}
+
+bool PipelineReloader::update() {
+    auto& device = _impl->device;
+    auto& retired = _impl->retired;
+    bool swapped = false;
+    {
+        std::lock_guard lock(_impl->mutex);
+        if (_impl->pending && _impl->current) {
+            // we're between frames, so everything recorded with the old pipeline has been submitted by now
+            retired.emplace_back(last_submitted_ticket(device), std::move(_impl->current));
+            _impl->current = std::move(_impl->pending);
+            swapped = true;
+        }
+    }
+
+    std::erase_if(retired, [&](auto& entry) { return device.is_done(std::get<0>(entry)); });
+    return swapped;
+}
+
+PipelineReloader::~PipelineReloader() = default;
+
+}
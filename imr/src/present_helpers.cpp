@@ -11,17 +11,12 @@ void Swapchain::Frame::presentFromBuffer(VkBuffer buffer, VkFence signal_when_re
     assert(signal_when_reusable != VK_NULL_HANDLE);
 
     std::vector<VkSemaphore> semaphores;
-    semaphores.push_back(swapchain_image_available);
+    if (swapchain_image_available)
+        semaphores.push_back(swapchain_image_available);
     if (sem)
         semaphores.push_back(*sem);
 
-    VkCommandBuffer cmdbuf;
-    CHECK_VK_THROW(vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = device.pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
-    }), &cmdbuf));
+    VkCommandBuffer cmdbuf = slot.next_command_buffer();
 
     CHECK_VK_THROW(vkBeginCommandBuffer(cmdbuf, tmpPtr<VkCommandBufferBeginInfo>({
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -48,15 +43,15 @@ void Swapchain::Frame::presentFromBuffer(VkBuffer buffer, VkFence signal_when_re
             }
         }),
     }));
-    VkExtent2D src_size = swapchain._impl->swapchain.extent;
+    VkExtent2D src_size = swapchain._impl->extent();
     vkCmdCopyBufferToImage(cmdbuf, buffer, slot.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, tmpPtr<VkBufferImageCopy>({
         .imageSubresource = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
             .layerCount = 1,
         },
         .imageExtent = {
-            .width = swapchain._impl->swapchain.extent.width,
-            .height = swapchain._impl->swapchain.extent.height,
+            .width = swapchain._impl->extent().width,
+            .height = swapchain._impl->extent().height,
             .depth = 1
         }
     }));
@@ -71,7 +66,7 @@ void Swapchain::Frame::presentFromBuffer(VkBuffer buffer, VkFence signal_when_re
             .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
             .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
             .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .newLayout = swapchain._impl->final_layout(),
             .image = slot.image,
             .subresourceRange = {
                 .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
@@ -81,25 +76,19 @@ void Swapchain::Frame::presentFromBuffer(VkBuffer buffer, VkFence signal_when_re
         }),
     }));
 
-    std::vector<VkPipelineStageFlags> stage_flags;
-    for (auto& sem : semaphores)
-        stage_flags.emplace_back(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    std::vector<VkSemaphoreSubmitInfo> wait_infos;
+    for (auto& sem : semaphores) {
+        wait_infos.push_back({
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = sem,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        });
+    }
 
     vkEndCommandBuffer(cmdbuf);
-    vkQueueSubmit(device.main_queue, 1, tmpPtr<VkSubmitInfo>({
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = static_cast<uint32_t>(semaphores.size()),
-        .pWaitSemaphores = semaphores.data(),
-        .pWaitDstStageMask = stage_flags.data(),
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuf,
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &slot.present_semaphore,
-    }), signal_when_reusable);
-
-    addCleanupAction([=, &device]() {
-        vkFreeCommandBuffers(device.device, device.pool, 1, &cmdbuf);
-    });
+    uint64_t ticket = device.submit({ cmdbuf }, wait_infos, semaphore_submit_infos({ signal_when_ready }), signal_when_reusable);
+
+    addCleanupTicket(ticket);
 
     queuePresent();
 }
@@ -111,20 +100,15 @@ void Swapchain::Frame::presentFromImage(VkImage image, VkFence signal_when_reusa
     auto& vk = device.dispatch;
 
     std::vector<VkSemaphore> semaphores;
-    semaphores.push_back(swapchain_image_available);
+    if (swapchain_image_available)
+        semaphores.push_back(swapchain_image_available);
     if (sem)
         semaphores.push_back(*sem);
 
     assert(image != slot.image);
     assert(signal_when_reusable != VK_NULL_HANDLE);
 
-    VkCommandBuffer cmdbuf;
-    vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = device.pool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
-    }), &cmdbuf);
+    VkCommandBuffer cmdbuf = slot.next_command_buffer();
 
     vkBeginCommandBuffer(cmdbuf, tmpPtr<VkCommandBufferBeginInfo>({
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -155,7 +139,7 @@ void Swapchain::Frame::presentFromImage(VkImage image, VkFence signal_when_reusa
     if (image_size)
         src_size = *image_size;
     else
-        src_size = swapchain._impl->swapchain.extent;
+        src_size = swapchain._impl->extent();
     vkCmdBlitImage(cmdbuf, image, src_layout, slot.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, tmpPtr<VkImageBlit>({
         .srcSubresource = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
@@ -176,8 +160,8 @@ void Swapchain::Frame::presentFromImage(VkImage image, VkFence signal_when_reusa
         .dstOffsets = {
             {},
             {
-                .x = (int32_t) swapchain._impl->swapchain.extent.width,
-                .y = (int32_t) swapchain._impl->swapchain.extent.height,
+                .x = (int32_t) swapchain._impl->extent().width,
+                .y = (int32_t) swapchain._impl->extent().height,
                 .z = 1,
             },
         }
@@ -193,7 +177,7 @@ void Swapchain::Frame::presentFromImage(VkImage image, VkFence signal_when_reusa
             .dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
             .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
             .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .newLayout = swapchain._impl->final_layout(),
             .image = slot.image,
             .subresourceRange = {
                 .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
@@ -203,25 +187,19 @@ void Swapchain::Frame::presentFromImage(VkImage image, VkFence signal_when_reusa
         }),
     }));
 
-    std::vector<VkPipelineStageFlags> stage_flags;
-    for (auto& sem : semaphores)
-        stage_flags.emplace_back(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    std::vector<VkSemaphoreSubmitInfo> wait_infos;
+    for (auto& sem : semaphores) {
+        wait_infos.push_back({
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = sem,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        });
+    }
 
     vkEndCommandBuffer(cmdbuf);
-    vkQueueSubmit(device.main_queue, 1, tmpPtr<VkSubmitInfo>({
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = static_cast<uint32_t>(semaphores.size()),
-        .pWaitSemaphores = semaphores.data(),
-        .pWaitDstStageMask = stage_flags.data(),
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuf,
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &slot.present_semaphore,
-    }), signal_when_reusable);
-
-    addCleanupAction([=, &device]() {
-        vkFreeCommandBuffers(device.device, device.pool, 1, &cmdbuf);
-    });
+    uint64_t ticket = device.submit({ cmdbuf }, wait_infos, semaphore_submit_infos({ signal_when_ready }), signal_when_reusable);
+
+    addCleanupTicket(ticket);
 
     queuePresent();
 }
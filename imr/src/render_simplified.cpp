@@ -1,4 +1,4 @@
-#include "imr/imr.h"
+#include "swapchain_private.h"
 
 namespace imr {
 
@@ -30,14 +30,8 @@ void Swapchain::renderFrameSimplified(std::function<void(SimplifiedRenderContext
     beginFrame([&](Frame& frame) {
         auto& image = frame.image();
 
-        // Allocate and begin recording a command buffer
-        VkCommandBuffer cmdbuf;
-        vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = device.pool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1,
-        }), &cmdbuf);
+        // Grab one of the slot's command buffers and begin recording
+        VkCommandBuffer cmdbuf = frame._impl->slot.next_command_buffer();
         vkBeginCommandBuffer(cmdbuf, tmpPtr<VkCommandBufferBeginInfo>({
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
             .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
@@ -67,7 +61,7 @@ void Swapchain::renderFrameSimplified(std::function<void(SimplifiedRenderContext
         SimplifiedRenderContextImpl context(frame, cmdbuf);
         fn(context);
 
-        // This barrier transitions the image from the "general" layout into the "present src" layout so it can be shown
+        // This barrier transitions the image from the "general" layout into the "present src" layout so it can be shown (offscreen images stay in "general")
         // before the barrier: all writes from any pipeline stage
         // after the barrier: all reads from the present stage
         vk.cmdPipelineBarrier2KHR(cmdbuf, tmpPtr<VkDependencyInfo>({
@@ -81,40 +75,20 @@ void Swapchain::renderFrameSimplified(std::function<void(SimplifiedRenderContext
                 .dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                 .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
                 .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-                .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                .newLayout = _impl->final_layout(),
                 .image = image.handle(),
                 .subresourceRange = image.whole_image_subresource_range()
             }),
         }));
 
-        // Create a fence so we can track the execution of the cmdbuf
-        VkFence fence;
-        vkCreateFence(device.device, tmpPtr<VkFenceCreateInfo>({
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = 0,
-        }), nullptr, &fence);
-
-        // Finish the cmdbuf and submit it to the GPU, and pass the fence so we're notified when it's done
+        // Finish the cmdbuf and submit it to the GPU, the ticket tells us when it's done
         // before: wait on the swapchain image to be available
         // after: notify the swapchain that the image can be shown
         vkEndCommandBuffer(cmdbuf);
-        vkQueueSubmit(device.main_queue, 1, tmpPtr<VkSubmitInfo>({
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = &frame.swapchain_image_available,
-            .pWaitDstStageMask = tmpPtr((VkPipelineStageFlags) VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT),
-            .commandBufferCount = 1,
-            .pCommandBuffers = &cmdbuf,
-            .signalSemaphoreCount = 1,
-            .pSignalSemaphores = &frame.signal_when_ready,
-        }), fence);
-
-        // cleanup those objects once the cmdbuf has executed
-        frame.addCleanupFence(fence);
-        frame.addCleanupAction([=, &device]() {
-            vkDestroyFence(device.device, fence, nullptr);
-            vkFreeCommandBuffers(device.device, device.pool, 1, &cmdbuf);
-        });
+        uint64_t ticket = device.submit({ cmdbuf }, semaphore_submit_infos({ frame.swapchain_image_available }), semaphore_submit_infos({ frame.signal_when_ready }));
+
+        // the cmdbuf gets recycled once it has executed
+        frame.addCleanupTicket(ticket);
 
         frame.queuePresent();
     });
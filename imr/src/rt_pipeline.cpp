@@ -110,7 +110,8 @@ namespace imr {
                 .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
                 .stage = ept->stage(),
                 .module = ept->module().vk_shader_module(),
-                .pName = ept->name().c_str()
+                .pName = ept->name().c_str(),
+                .pSpecializationInfo = ept->_impl->vk_specialization_info(),
             };
             shaderStages.push_back(stage_create_info);
             return shaderStages.size() - 1;
@@ -167,7 +168,7 @@ namespace imr {
         }
 
         assert(merged_layout);
-        layout = std::make_unique<PipelineLayout>(device, *merged_layout);
+        layout = get_pipeline_layout(device, *merged_layout);
         final_layout = *merged_layout;
 
         /*
@@ -181,7 +182,10 @@ namespace imr {
         rayTracingPipelineCI.pGroups = shaderGroups.data();
         rayTracingPipelineCI.maxPipelineRayRecursionDepth = 4;
         rayTracingPipelineCI.layout = layout->pipeline_layout;
-        vk.createRayTracingPipelinesKHR(VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rayTracingPipelineCI, nullptr, &pipeline);
+        PipelineCreationFeedback feedback;
+        rayTracingPipelineCI.pNext = &feedback.info;
+        vk.createRayTracingPipelinesKHR(VK_NULL_HANDLE, device.pipelineCache(), 1, &rayTracingPipelineCI, nullptr, &pipeline);
+        feedback.record(device);
     }
 
     void RayTracingPipeline::Impl::createShaderBindingTable(ShaderEntryPoint* raygen, std::vector<HitShadersTriple> hit_shaders, std::vector<ShaderEntryPoint*> miss_shaders, std::vector<ShaderEntryPoint*> callables) {
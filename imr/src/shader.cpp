@@ -13,24 +13,111 @@ extern "C" {
 
 }
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
 
 namespace imr {
 
-SPIRVModule load_spirv_module(const std::string& filename) {
-    size_t size;
-    uint32_t* data;
+std::filesystem::path spirv_module_path(const std::string& filename) {
     const char* loc = imr_get_executable_location();
-    if (!imr_read_file((std::filesystem::path(loc).parent_path().string() + "/" + filename).c_str(), &size, (unsigned char**) &data))
-        throw std::runtime_error("Failed to read " + filename);
-    SPIRVModule module;
-    module.resize(size / 4);
-    memcpy(module.data(), data, size);
-    free(data);
+    auto path = std::filesystem::path(loc).parent_path() / filename;
     free((char*) loc);
+    return path;
+}
+
+SPIRVModule load_spirv_module(const std::string& filename) {
+    std::ifstream file(spirv_module_path(filename), std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("Failed to read " + filename);
+    SPIRVModule module(static_cast<size_t>(file.tellg()) / 4);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(module.data()), module.size() * 4))
+        throw std::runtime_error("Failed to read " + filename);
     return module;
 }
 
+VkExtent3D reflect_local_size(const SPIRVModule& spirv_module, const std::string& entry_point, const SpecializationConstants& specialization) {
+    uint32_t entry_point_id = ~0u;
+    std::unordered_map<uint32_t, std::array<uint32_t, 3>> local_sizes;
+    std::unordered_map<uint32_t, std::array<uint32_t, 3>> local_size_ids;
+    uint32_t workgroup_size_id = 0;
+    std::unordered_map<uint32_t, uint32_t> spec_ids;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, std::array<uint32_t, 3>> composites;
+
+    // just the handful of instructions that matter, the header is 5 words
+    for (size_t i = 5; i < spirv_module.size();) {
+        uint32_t word_count = spirv_module[i] >> 16;
+        uint32_t opcode = spirv_module[i] & 0xffff;
+        if (word_count == 0 || i + word_count > spirv_module.size())
+            break;
+        const uint32_t* operands = &spirv_module[i + 1];
+        uint32_t operands_count = word_count - 1;
+        switch (opcode) {
+            case 15: // OpEntryPoint
+                if (operands_count >= 3 && strncmp(reinterpret_cast<const char*>(&operands[2]), entry_point.c_str(), (operands_count - 2) * 4) == 0)
+                    entry_point_id = operands[1];
+                break;
+            case 16: // OpExecutionMode LocalSize
+                if (operands_count >= 5 && operands[1] == 17)
+                    local_sizes[operands[0]] = { operands[2], operands[3], operands[4] };
+                break;
+            case 331: // OpExecutionModeId LocalSizeId
+                if (operands_count >= 5 && operands[1] == 38)
+                    local_size_ids[operands[0]] = { operands[2], operands[3], operands[4] };
+                break;
+            case 71: // OpDecorate
+                if (operands_count >= 3 && operands[1] == 1) // SpecId
+                    spec_ids[operands[0]] = operands[2];
+                if (operands_count >= 3 && operands[1] == 11 && operands[2] == 25) // BuiltIn WorkgroupSize
+                    workgroup_size_id = operands[0];
+                break;
+            case 43: // OpConstant
+            case 50: // OpSpecConstant
+                if (operands_count >= 3)
+                    constants[operands[1]] = operands[2];
+                break;
+            case 44: // OpConstantComposite
+            case 51: // OpSpecConstantComposite
+                if (operands_count >= 5)
+                    composites[operands[1]] = { operands[2], operands[3], operands[4] };
+                break;
+        }
+        i += word_count;
+    }
+
+    auto value = [&](uint32_t id) -> uint32_t {
+        auto spec_id = spec_ids.find(id);
+        if (spec_id != spec_ids.end()) {
+            for (auto& entry : specialization.entries) {
+                if (entry.constantID == spec_id->second && entry.size == sizeof(uint32_t)) {
+                    uint32_t specialized;
+                    memcpy(&specialized, specialization.data.data() + entry.offset, sizeof(uint32_t));
+                    return specialized;
+                }
+            }
+        }
+        auto constant = constants.find(id);
+        return constant != constants.end() ? constant->second : 1;
+    };
+
+    // the WorkgroupSize built-in overrides the execution modes, that's where local_size_x_id & co. end up
+    std::array<uint32_t, 3> size = { 1, 1, 1 };
+    if (composites.contains(workgroup_size_id)) {
+        for (int i = 0; i < 3; i++)
+            size[i] = value(composites[workgroup_size_id][i]);
+    } else if (local_size_ids.contains(entry_point_id)) {
+        for (int i = 0; i < 3; i++)
+            size[i] = value(local_size_ids[entry_point_id][i]);
+    } else if (local_sizes.contains(entry_point_id)) {
+        size = local_sizes[entry_point_id];
+    }
+    return { size[0], size[1], size[2] };
+}
+
 ReflectedLayout::ReflectedLayout(imr::SPIRVModule& spirv_module, VkShaderStageFlags stage) : stages(stage) {
     auto config = shd_default_compiler_config();
     auto target = shd_default_target_config();
@@ -158,123 +245,276 @@ ReflectedLayout::ReflectedLayout(imr::ReflectedLayout& a, imr::ReflectedLayout&
     }
 }
 
-PipelineLayout::PipelineLayout(imr::Device& device, imr::ReflectedLayout& reflected_layout) : device(device) {
-    int max_set = 0;
-    for (auto& [set, value] : reflected_layout.set_bindings) {
-        if (set > max_set)
-            max_set = set;
+ReflectedLayout ReflectedLayout::with_stage(VkShaderStageFlags stage) const {
+    ReflectedLayout copy = *this;
+    copy.stages = stage;
+    for (auto& range : copy.push_constants)
+        range.stageFlags = stage;
+    for (auto& [set, bindings] : copy.set_bindings) {
+        for (auto& binding : bindings)
+            binding.stageFlags = stage;
     }
-    assert(max_set < 32);
-    set_layouts.resize(max_set + 1);
-    for (unsigned set = 0; set < max_set + 1; set++) {
-        auto& bindings = reflected_layout.set_bindings[set];
-        std::vector<VkDescriptorBindingFlags> flags;
-        flags.resize(bindings.size());
-        for (auto binding : bindings) {
-            if (binding.descriptorCount == 0)
-                flags[binding.binding] |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
-        }
+    return copy;
+}
 
-        VkDescriptorSetLayoutBindingFlagsCreateInfo flags_for_bindings_info = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-            .bindingCount = static_cast<uint32_t>(bindings.size()),
-            .pBindingFlags = flags.data()
-        };
+DescriptorSetLayout::DescriptorSetLayout(imr::Device& device, std::vector<VkDescriptorSetLayoutBinding>& bindings) : device(device) {
+    std::vector<VkDescriptorBindingFlags> flags;
+    flags.resize(bindings.size());
+    for (size_t i = 0; i < bindings.size(); i++) {
+        if (bindings[i].descriptorCount == 0)
+            flags[i] |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_for_bindings_info = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindingFlags = flags.data()
+    };
+
+    CHECK_VK_THROW(vkCreateDescriptorSetLayout(device.device, tmpPtr<VkDescriptorSetLayoutCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &flags_for_bindings_info,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data(),
+    }), nullptr, &set_layout));
+}
+
+DescriptorSetLayout::~DescriptorSetLayout() {
+    vkDestroyDescriptorSetLayout(device.device, set_layout, nullptr);
+}
 
-        CHECK_VK_THROW(vkCreateDescriptorSetLayout(device.device, tmpPtr<VkDescriptorSetLayoutCreateInfo>({
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            .pNext = &flags_for_bindings_info,
-            .bindingCount = static_cast<uint32_t>(bindings.size()),
-            .pBindings = bindings.data(),
-        }), nullptr, &set_layouts[set]));
+/// Expects layouts_mutex to be held
+static std::shared_ptr<DescriptorSetLayout> get_descriptor_set_layout(imr::Device& device, std::vector<VkDescriptorSetLayoutBinding> bindings) {
+    // the order bindings were reflected in doesn't matter to Vulkan, so it shouldn't matter to the cache either
+    std::sort(bindings.begin(), bindings.end(), [](auto& a, auto& b) { return a.binding < b.binding; });
+    std::vector<uint32_t> key;
+    for (auto& binding : bindings) {
+        key.push_back(binding.binding);
+        key.push_back(binding.descriptorType);
+        key.push_back(binding.descriptorCount);
+        key.push_back(binding.stageFlags);
     }
 
+    auto& cached = device._impl->descriptor_set_layouts[key];
+    if (auto existing = cached.lock())
+        return existing;
+    auto set_layout = std::make_shared<DescriptorSetLayout>(device, bindings);
+    cached = set_layout;
+    return set_layout;
+}
+
+PipelineLayout::PipelineLayout(imr::Device& device, std::vector<std::shared_ptr<DescriptorSetLayout>>&& shared_set_layouts, std::vector<VkPushConstantRange>& push_constants) : device(device), shared_set_layouts(std::move(shared_set_layouts)) {
+    for (auto& set_layout : this->shared_set_layouts)
+        set_layouts.push_back(set_layout->set_layout);
+
     CHECK_VK_THROW(vkCreatePipelineLayout(device.device, tmpPtr<VkPipelineLayoutCreateInfo>({
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = static_cast<uint32_t>(set_layouts.size()),
         .pSetLayouts = set_layouts.data(),
-        .pushConstantRangeCount = static_cast<uint32_t>(reflected_layout.push_constants.size()),
-        .pPushConstantRanges = reflected_layout.push_constants.data()
+        .pushConstantRangeCount = static_cast<uint32_t>(push_constants.size()),
+        .pPushConstantRanges = push_constants.data()
     }), nullptr, &pipeline_layout));
 }
 
 PipelineLayout::~PipelineLayout() {
     vkDestroyPipelineLayout(device.device, pipeline_layout, nullptr);
-    for (auto set_layout : set_layouts)
-        vkDestroyDescriptorSetLayout(device.device, set_layout, nullptr);
+}
+
+std::shared_ptr<PipelineLayout> get_pipeline_layout(imr::Device& device, imr::ReflectedLayout& reflected_layout) {
+    int max_set = 0;
+    for (auto& [set, value] : reflected_layout.set_bindings) {
+        if (set > max_set)
+            max_set = set;
+    }
+    assert(max_set < 32);
+
+    std::lock_guard lock(device._impl->layouts_mutex);
+    std::vector<std::shared_ptr<DescriptorSetLayout>> set_layouts;
+    // identical set layouts are shared, so comparing the handles is enough to identify the pipeline layout
+    std::vector<uint64_t> key;
+    for (int set = 0; set < max_set + 1; set++) {
+        auto found = reflected_layout.set_bindings.find(set);
+        set_layouts.push_back(get_descriptor_set_layout(device, found != reflected_layout.set_bindings.end() ? found->second : std::vector<VkDescriptorSetLayoutBinding>()));
+        key.push_back(reinterpret_cast<uint64_t>(set_layouts.back()->set_layout));
+    }
+    for (auto& range : reflected_layout.push_constants) {
+        key.push_back(range.stageFlags);
+        key.push_back(range.offset);
+        key.push_back(range.size);
+    }
+
+    auto& cached = device._impl->pipeline_layouts[key];
+    if (auto existing = cached.lock())
+        return existing;
+    auto pipeline_layout = std::make_shared<PipelineLayout>(device, std::move(set_layouts), reflected_layout.push_constants);
+    cached = pipeline_layout;
+    return pipeline_layout;
 }
 
 ShaderModule::ShaderModule(imr::Device& device, std::string&& spirv_filename) noexcept(false) {
+    if (auto registered = find_registered_spirv(spirv_filename)) {
+        _impl = std::make_unique<Impl>(device, *registered);
+        return;
+    }
     auto spirv_module = load_spirv_module(spirv_filename);
-    _impl = std::make_unique<Impl>(device, std::move(spirv_module));
+    _impl = std::make_unique<Impl>(device, spirv_module, std::move(spirv_module));
 }
 
-ShaderModule::Impl::Impl(imr::Device& device, imr::SPIRVModule&& spirv_module) noexcept(false) : device(device), spirv_module(std::move(spirv_module)) {
-    assert(this->spirv_module.size() > 0);
-    CHECK_VK(vkCreateShaderModule(device.device, tmpPtr<VkShaderModuleCreateInfo>({
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .flags = 0,
-            .codeSize = this->spirv_module.size() * 4,
-            .pCode = this->spirv_module.data(),
-    }), nullptr, &vk_shader_module), throw std::runtime_error("Failed to build shader module"));
+ShaderModule::ShaderModule(imr::Device& device, std::span<const uint32_t> spirv) noexcept(false) {
+    _impl = std::make_unique<Impl>(device, spirv);
 }
 
-VkShaderModule ShaderModule::vk_shader_module() const { return _impl->vk_shader_module; }
+ShaderModule::ShaderModule(std::unique_ptr<Impl>&& impl) : _impl(std::move(impl)) {}
 
-ShaderModule::Impl::~Impl() {
-    vkDestroyShaderModule(device.device, vk_shader_module, nullptr);
+ShaderModule::Impl::Impl(imr::Device& device, std::span<const uint32_t> spirv, SPIRVModule&& storage) noexcept(false) : device(device) {
+    assert(spirv.size() > 0);
+    handle = get_shader_module(device, spirv, std::move(storage));
 }
 
+VkShaderModule ShaderModule::vk_shader_module() const { return _impl->handle->vk_shader_module; }
+
+ShaderModule::Impl::~Impl() = default;
+
 ShaderModule::~ShaderModule() = default;
 
-ShaderEntryPoint::ShaderEntryPoint(imr::ShaderModule& module, VkShaderStageFlagBits stage, const std::string& entrypoint_name) {
-    _impl = std::make_unique<Impl>(module, stage, entrypoint_name);
+SpecializationConstants& SpecializationConstants::set_bytes(uint32_t constant_id, const void* value, size_t size) {
+    auto found = std::find_if(entries.begin(), entries.end(), [&](auto& entry) { return entry.constantID == constant_id; });
+    if (found != entries.end()) {
+        if (found->size == size) {
+            memcpy(data.data() + found->offset, value, size);
+            return *this;
+        }
+        // the size changed, start over with this one left out
+        SpecializationConstants others;
+        for (auto& entry : entries) {
+            if (entry.constantID != constant_id)
+                others.set_bytes(entry.constantID, data.data() + entry.offset, entry.size);
+        }
+        *this = std::move(others);
+    }
+
+    VkSpecializationMapEntry entry = {
+        .constantID = constant_id,
+        .offset = static_cast<uint32_t>(data.size()),
+        .size = size,
+    };
+    data.resize(data.size() + size);
+    memcpy(data.data() + entry.offset, value, size);
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, [](auto& a, auto& b) { return a.constantID < b.constantID; }), entry);
+    return *this;
+}
+
+VkSpecializationInfo SpecializationConstants::info() const {
+    return {
+        .mapEntryCount = static_cast<uint32_t>(entries.size()),
+        .pMapEntries = entries.data(),
+        .dataSize = data.size(),
+        .pData = data.data(),
+    };
+}
+
+std::vector<uint8_t> SpecializationConstants::key() const {
+    // entries are sorted, but their data is in the order they were first set in
+    std::vector<uint8_t> key;
+    for (auto& entry : entries) {
+        auto id = reinterpret_cast<const uint8_t*>(&entry.constantID);
+        key.insert(key.end(), id, id + sizeof(entry.constantID));
+        key.push_back(static_cast<uint8_t>(entry.size));
+        key.insert(key.end(), data.begin() + entry.offset, data.begin() + entry.offset + entry.size);
+    }
+    return key;
 }
 
-ShaderEntryPoint::Impl::Impl(imr::ShaderModule& module, VkShaderStageFlagBits stage, const std::string& name) : module(module), stage(stage), name(name) {
-    reflected = std::make_unique<ReflectedLayout>(module._impl->spirv_module, stage);
+ShaderEntryPoint::ShaderEntryPoint(imr::ShaderModule& module, VkShaderStageFlagBits stage, const std::string& entrypoint_name, SpecializationConstants specialization) {
+    _impl = std::make_unique<Impl>(module, stage, entrypoint_name, std::move(specialization));
+}
+
+ShaderEntryPoint::Impl::Impl(imr::ShaderModule& module, VkShaderStageFlagBits stage, const std::string& name, SpecializationConstants&& specialization) : module(module), stage(stage), name(name), specialization(std::move(specialization)) {
+    reflected = std::make_unique<ReflectedLayout>(reflect_shader_module(*module._impl->handle)->with_stage(stage));
+    specialization_info = this->specialization.info();
 }
 
 const std::string& ShaderEntryPoint::name() const { return _impl->name; }
 
 const ShaderModule& ShaderEntryPoint::module() const { return _impl->module; }
 
+const SpecializationConstants& ShaderEntryPoint::specialization() const { return _impl->specialization; }
+
 VkShaderStageFlagBits ShaderEntryPoint::stage() const { return _impl->stage; }
 
 ShaderEntryPoint::Impl::~Impl() = default;
 
 ShaderEntryPoint::~ShaderEntryPoint() = default;
 
-ComputePipeline::Impl::Impl(imr::Device& device, imr::ShaderEntryPoint& entry_point) : device(device) {
-    layout = std::make_unique<PipelineLayout>(device, *entry_point._impl->reflected);
+/// Throws if the device can't honour it, fills in the structure to chain into the shader stage (if needed) and returns the stage flags
+static VkPipelineShaderStageCreateFlags subgroup_size_control_flags(Device& device, const SubgroupSizeControl& control, VkPipelineShaderStageRequiredSubgroupSizeCreateInfo& required_size) {
+    auto& capabilities = device.capabilities;
+    if ((control.required_size || control.full_subgroups || control.allow_varying_size) && !capabilities.subgroup_size_control)
+        throw std::runtime_error("Subgroup size control is not supported by this device");
+    if (control.required_size && control.allow_varying_size)
+        throw std::runtime_error("A required subgroup size can't vary");
+
+    VkPipelineShaderStageCreateFlags flags = 0;
+    if (control.required_size) {
+        bool power_of_two = (control.required_size & (control.required_size - 1)) == 0;
+        if (!power_of_two || control.required_size < capabilities.min_subgroup_size || control.required_size > capabilities.max_subgroup_size)
+            throw std::runtime_error("Subgroup size " + std::to_string(control.required_size) + " is not supported, the device can do powers of two from " + std::to_string(capabilities.min_subgroup_size) + " to " + std::to_string(capabilities.max_subgroup_size));
+        required_size = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
+            .requiredSubgroupSize = control.required_size,
+        };
+    }
+    if (control.full_subgroups)
+        flags |= VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT;
+    if (control.allow_varying_size)
+        flags |= VK_PIPELINE_SHADER_STAGE_CREATE_ALLOW_VARYING_SUBGROUP_SIZE_BIT;
+    return flags;
+}
+
+ComputePipeline::Impl::Impl(imr::Device& device, imr::ShaderEntryPoint& entry_point, const SubgroupSizeControl& subgroup_size_control) : device(device) {
+    layout = get_pipeline_layout(device, *entry_point._impl->reflected);
+
+    VkPipelineShaderStageRequiredSubgroupSizeCreateInfo required_size = {};
+    VkPipelineShaderStageCreateFlags stage_flags = subgroup_size_control_flags(device, subgroup_size_control, required_size);
+    subgroup_size = subgroup_size_control.required_size ? subgroup_size_control.required_size : device.capabilities.subgroup_size;
+    local_size = reflect_local_size(entry_point._impl->module._impl->handle->spirv_module, entry_point.name(), entry_point.specialization());
 
     pipeline = VK_NULL_HANDLE;
-    CHECK_VK_THROW(vkCreateComputePipelines(device.device, VK_NULL_HANDLE, 1, tmpPtr<VkComputePipelineCreateInfo>({
+    PipelineCreationFeedback feedback;
+    CHECK_VK_THROW(vkCreateComputePipelines(device.device, device.pipelineCache(), 1, tmpPtr<VkComputePipelineCreateInfo>({
             .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .pNext = &feedback.info,
             .flags = 0,
             .stage = {
                     .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                    .flags = 0,
+                    .pNext = subgroup_size_control.required_size ? &required_size : nullptr,
+                    .flags = stage_flags,
                     .stage = entry_point.stage(),
                     .module = entry_point._impl->module.vk_shader_module(),
                     .pName = entry_point.name().c_str(),
+                    .pSpecializationInfo = entry_point._impl->vk_specialization_info(),
             },
             .layout = layout->pipeline_layout,
     }), nullptr, &pipeline));
+    feedback.record(device);
+
+    launch_cache = std::make_unique<LaunchCache>(device, *layout, *entry_point._impl->reflected);
 }
 
-ComputePipeline::Impl::Impl(imr::Device& device, std::unique_ptr<ShaderModule>&& module, std::unique_ptr<ShaderEntryPoint>&& ep) : Impl(device, *ep) {
+ComputePipeline::Impl::Impl(imr::Device& device, std::unique_ptr<ShaderModule>&& module, std::unique_ptr<ShaderEntryPoint>&& ep, const SubgroupSizeControl& subgroup_size_control) : Impl(device, *ep, subgroup_size_control) {
     this->module = std::move(module);
     this->entry_point = std::move(ep);
-    assert(this->module && this->entry_point);
+    assert(this->entry_point);
 }
 
-ComputePipeline::ComputePipeline(imr::Device& device, std::string&& spirv_filename, std::string&& entrypoint_name) {
+ComputePipeline::ComputePipeline(imr::Device& device, std::string&& spirv_filename, std::string&& entrypoint_name, SpecializationConstants specialization, SubgroupSizeControl subgroup_size_control) {
     auto shader_module = std::make_unique<ShaderModule>(device, std::move(spirv_filename));
-    auto entry_point = std::make_unique<ShaderEntryPoint>(*shader_module, VK_SHADER_STAGE_COMPUTE_BIT, entrypoint_name);
-    _impl = std::make_unique<ComputePipeline::Impl>(device, std::move(shader_module), std::move(entry_point));
+    auto entry_point = std::make_unique<ShaderEntryPoint>(*shader_module, VK_SHADER_STAGE_COMPUTE_BIT, entrypoint_name, std::move(specialization));
+    _impl = std::make_unique<ComputePipeline::Impl>(device, std::move(shader_module), std::move(entry_point), subgroup_size_control);
 }
 
+ComputePipeline::ComputePipeline(std::unique_ptr<Impl>&& impl) : _impl(std::move(impl)) {}
+
 ComputePipeline::Impl::~Impl() {
     vkDestroyPipeline(device.device, pipeline, nullptr);
 }
@@ -282,7 +522,32 @@ ComputePipeline::Impl::~Impl() {
 VkPipeline ComputePipeline::pipeline() const { return _impl->pipeline; }
 VkPipelineLayout ComputePipeline::layout() const { return _impl->layout->pipeline_layout; }
 VkDescriptorSetLayout ComputePipeline::set_layout(unsigned i) const { return _impl->layout->set_layouts[i]; }
+uint32_t ComputePipeline::subgroup_size() const { return _impl->subgroup_size; }
+VkExtent3D ComputePipeline::local_size() const { return _impl->local_size; }
+
+void ComputePipeline::dispatch_for_extent(VkCommandBuffer cmdbuf, VkExtent3D extent) const {
+    auto groups = groups_for_extent(extent);
+    vkCmdDispatch(cmdbuf, groups.width, groups.height, groups.depth);
+}
 
 ComputePipeline::~ComputePipeline() {}
 
+ComputePipelineVariants::ComputePipelineVariants(imr::Device& device, std::string spirv_filename, std::string entrypoint_name) {
+    _impl = std::make_unique<Impl>(device, std::make_unique<ShaderModule>(device, std::move(spirv_filename)), std::move(entrypoint_name));
+}
+
+ComputePipeline& ComputePipelineVariants::get(const SpecializationConstants& specialization) {
+    auto key = specialization.key();
+    std::lock_guard lock(_impl->mutex);
+    auto& variant = _impl->variants[key];
+    if (!variant) {
+        // the module is shared by all variants, so its reflection (and the layout) only gets done once
+        auto entry_point = std::make_unique<ShaderEntryPoint>(*_impl->module, VK_SHADER_STAGE_COMPUTE_BIT, _impl->entrypoint_name, specialization);
+        variant = std::make_unique<ComputePipeline>(std::make_unique<ComputePipeline::Impl>(_impl->device, nullptr, std::move(entry_point)));
+    }
+    return *variant;
+}
+
+ComputePipelineVariants::~ComputePipelineVariants() = default;
+
 }
@@ -0,0 +1,214 @@
+#include "shader_private.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace imr {
+
+uint64_t hash_bytes(const void* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+uint64_t hash_spirv(const SPIRVModule& spirv_module) {
+    return hash_bytes(spirv_module.data(), spirv_module.size() * 4);
+}
+
+uint64_t check_hash_spirv(const SPIRVModule& spirv_module) {
+    // FNV-1a again, but from another basis and back to front
+    uint64_t hash = 0x84222325cbf29ce4;
+    auto bytes = reinterpret_cast<const uint8_t*>(spirv_module.data());
+    for (size_t i = spirv_module.size() * 4; i > 0; i--) {
+        hash ^= bytes[i - 1];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+ShaderModuleHandle::ShaderModuleHandle(imr::Device& device, uint64_t hash, SPIRVModule&& spirv_module) noexcept(false) : device(device), hash(hash), spirv_module(std::move(spirv_module)) {
+    CHECK_VK(vkCreateShaderModule(device.device, tmpPtr<VkShaderModuleCreateInfo>({
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .flags = 0,
+            .codeSize = this->spirv_module.size() * 4,
+            .pCode = this->spirv_module.data(),
+    }), nullptr, &vk_shader_module), throw std::runtime_error("Failed to build shader module"));
+}
+
+ShaderModuleHandle::~ShaderModuleHandle() {
+    vkDestroyShaderModule(device.device, vk_shader_module, nullptr);
+}
+
+std::shared_ptr<ShaderModuleHandle> get_shader_module(imr::Device& device, std::span<const uint32_t> spirv, SPIRVModule&& storage) {
+    auto& impl = *device._impl;
+    uint64_t hash = hash_bytes(spirv.data(), spirv.size_bytes());
+    auto own_copy = [&]() {
+        if (storage.data() == spirv.data() && storage.size() == spirv.size())
+            return std::move(storage);
+        return SPIRVModule(spirv.begin(), spirv.end());
+    };
+
+    std::lock_guard lock(impl.shader_cache_mutex);
+    auto& cached = impl.shader_modules[hash];
+    if (auto existing = cached.lock()) {
+        if (std::equal(spirv.begin(), spirv.end(), existing->spirv_module.begin(), existing->spirv_module.end()))
+            return existing;
+        // a hash collision, the module works fine but it doesn't get shared
+        return std::make_shared<ShaderModuleHandle>(device, hash, own_copy());
+    }
+
+    auto handle = std::make_shared<ShaderModuleHandle>(device, hash, own_copy());
+    cached = handle;
+    return handle;
+}
+
+std::shared_ptr<const ReflectedLayout> reflect_shader_module(ShaderModuleHandle& module) {
+    auto& impl = *module.device._impl;
+    uint32_t spirv_words = module.spirv_module.size();
+    uint64_t check = check_hash_spirv(module.spirv_module);
+    auto matches = [&](const ReflectionCacheEntry& entry) {
+        return entry.reflected && entry.spirv_words == spirv_words && entry.check == check;
+    };
+    {
+        std::lock_guard lock(impl.shader_cache_mutex);
+        auto found = impl.reflection_cache.find(module.hash);
+        if (found != impl.reflection_cache.end() && matches(found->second)) {
+            found->second.last_used = ++impl.reflection_clock;
+            return found->second.reflected;
+        }
+    }
+
+    // parse outside the lock, so PipelineBatch workers don't take turns in shady. At worst two of them reflect the same module.
+    auto reflected = std::make_shared<const ReflectedLayout>(module.spirv_module, 0);
+
+    std::lock_guard lock(impl.shader_cache_mutex);
+    auto& entry = impl.reflection_cache[module.hash];
+    if (matches(entry)) {
+        entry.last_used = ++impl.reflection_clock;
+        return entry.reflected;
+    }
+    // new, or a collision: the last module reflected keeps the entry
+    entry = { spirv_words, check, std::move(reflected), ++impl.reflection_clock };
+    impl.reflection_cache_dirty = true;
+    return entry.reflected;
+}
+
+/// "IMRR", followed by a version that needs bumping whenever reflection or this layout changes
+static constexpr uint32_t reflection_cache_magic = 0x52524d49;
+static constexpr uint32_t reflection_cache_version = 2;
+
+/// Every hot reload edit adds an entry, only the most recently used ones get written back
+static constexpr size_t reflection_cache_max_entries = 256;
+
+/// Reflection doesn't depend on the device, one file serves all of them
+static std::filesystem::path reflection_cache_path() {
+    return cache_directory() / "reflection.bin";
+}
+
+void load_reflection_cache(Device& device) {
+    std::ifstream file(reflection_cache_path(), std::ios::binary);
+    if (!file)
+        return;
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<uint32_t> words(bytes.size() / 4);
+    memcpy(words.data(), bytes.data(), words.size() * 4);
+
+    size_t cursor = 0;
+    auto next = [&]() -> uint32_t {
+        if (cursor >= words.size())
+            throw std::runtime_error("truncated");
+        return words[cursor++];
+    };
+
+    std::unordered_map<uint64_t, ReflectionCacheEntry> entries;
+    try {
+        if (next() != reflection_cache_magic || next() != reflection_cache_version)
+            return;
+        uint32_t entries_count = next();
+        for (uint32_t i = 0; i < entries_count; i++) {
+            uint64_t hash = next();
+            hash |= static_cast<uint64_t>(next()) << 32;
+            uint32_t spirv_words = next();
+            uint64_t check = next();
+            check |= static_cast<uint64_t>(next()) << 32;
+
+            auto reflected = std::make_shared<ReflectedLayout>();
+            reflected->stages = 0;
+            uint32_t push_constants_count = next();
+            for (uint32_t j = 0; j < push_constants_count; j++) {
+                VkPushConstantRange range = { .stageFlags = 0 };
+                range.offset = next();
+                range.size = next();
+                reflected->push_constants.push_back(range);
+            }
+            uint32_t sets_count = next();
+            for (uint32_t j = 0; j < sets_count; j++) {
+                auto& bindings = reflected->set_bindings[next()];
+                uint32_t bindings_count = next();
+                for (uint32_t k = 0; k < bindings_count; k++) {
+                    VkDescriptorSetLayoutBinding binding = { .stageFlags = 0 };
+                    binding.binding = next();
+                    binding.descriptorType = static_cast<VkDescriptorType>(next());
+                    binding.descriptorCount = next();
+                    bindings.push_back(binding);
+                }
+            }
+            entries[hash] = { spirv_words, check, std::move(reflected) };
+        }
+    } catch (std::runtime_error&) {
+        // a stale or damaged cache just means parsing again
+        return;
+    }
+
+    std::lock_guard lock(device._impl->shader_cache_mutex);
+    device._impl->reflection_cache.merge(entries);
+}
+
+void save_reflection_cache(Device& device) {
+    auto& impl = *device._impl;
+    std::lock_guard lock(impl.shader_cache_mutex);
+    if (!impl.reflection_cache_dirty)
+        return;
+
+    // what this run used goes first, newest first, then whatever else the file had
+    std::vector<std::pair<uint64_t, const ReflectionCacheEntry*>> kept;
+    for (auto& [hash, entry] : impl.reflection_cache)
+        kept.emplace_back(hash, &entry);
+    std::sort(kept.begin(), kept.end(), [](auto& a, auto& b) { return a.second->last_used > b.second->last_used; });
+    kept.resize(std::min(kept.size(), reflection_cache_max_entries));
+
+    std::vector<uint32_t> words = { reflection_cache_magic, reflection_cache_version, static_cast<uint32_t>(kept.size()) };
+    for (auto& [hash, entry_ptr] : kept) {
+        auto& entry = *entry_ptr;
+        auto& reflected = entry.reflected;
+        words.push_back(static_cast<uint32_t>(hash));
+        words.push_back(static_cast<uint32_t>(hash >> 32));
+        words.push_back(entry.spirv_words);
+        words.push_back(static_cast<uint32_t>(entry.check));
+        words.push_back(static_cast<uint32_t>(entry.check >> 32));
+        words.push_back(reflected->push_constants.size());
+        for (auto& range : reflected->push_constants) {
+            words.push_back(range.offset);
+            words.push_back(range.size);
+        }
+        words.push_back(reflected->set_bindings.size());
+        for (auto& [set, bindings] : reflected->set_bindings) {
+            words.push_back(set);
+            words.push_back(bindings.size());
+            for (auto& binding : bindings) {
+                words.push_back(binding.binding);
+                words.push_back(binding.descriptorType);
+                words.push_back(binding.descriptorCount);
+            }
+        }
+    }
+
+    if (write_cache_file(reflection_cache_path(), words.data(), words.size() * 4))
+        impl.reflection_cache_dirty = false;
+}
+
+}
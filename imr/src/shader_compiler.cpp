@@ -0,0 +1,151 @@
+#include "shader_private.h"
+
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <cerrno>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+namespace imr {
+
+/// Bump whenever the way sources are compiled changes, so stale SPIR-V doesn't get picked up
+static constexpr uint32_t compiled_source_version = 1;
+
+static std::filesystem::path find_compiler(const char* env_variable, std::initializer_list<const char*> names) {
+    if (auto path = getenv(env_variable))
+        return path;
+#ifdef _WIN32
+    const char separator = ';';
+    const char* extension = ".exe";
+#else
+    const char separator = ':';
+    const char* extension = "";
+#endif
+    std::stringstream search_path(getenv("PATH") ? getenv("PATH") : "");
+    std::string directory;
+    while (std::getline(search_path, directory, separator)) {
+        for (auto name : names) {
+            auto candidate = std::filesystem::path(directory) / (std::string(name) + extension);
+            std::error_code error;
+            if (std::filesystem::is_regular_file(candidate, error))
+                return candidate;
+        }
+    }
+    throw std::runtime_error(std::string("Couldn't find ") + *names.begin() + ", put it on the PATH or point $" + env_variable + " to it");
+}
+
+/// Waits for the process to exit, returns whether it succeeded
+static bool run_process(const std::vector<std::string>& args) {
+#ifdef _WIN32
+    std::vector<const char*> argv;
+    for (auto& arg : args)
+        argv.push_back(arg.c_str());
+    argv.push_back(nullptr);
+    return _spawnv(_P_WAIT, argv[0], argv.data()) == 0;
+#else
+    std::vector<char*> argv;
+    for (auto& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+        return false;
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+static const char* glslang_stage_name(VkShaderStageFlagBits stage) {
+    switch (stage) {
+        case VK_SHADER_STAGE_VERTEX_BIT: return "vert";
+        case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return "tesc";
+        case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return "tese";
+        case VK_SHADER_STAGE_GEOMETRY_BIT: return "geom";
+        case VK_SHADER_STAGE_FRAGMENT_BIT: return "frag";
+        case VK_SHADER_STAGE_COMPUTE_BIT: return "comp";
+        case VK_SHADER_STAGE_TASK_BIT_EXT: return "task";
+        case VK_SHADER_STAGE_MESH_BIT_EXT: return "mesh";
+        case VK_SHADER_STAGE_RAYGEN_BIT_KHR: return "rgen";
+        case VK_SHADER_STAGE_ANY_HIT_BIT_KHR: return "rahit";
+        case VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR: return "rchit";
+        case VK_SHADER_STAGE_MISS_BIT_KHR: return "rmiss";
+        case VK_SHADER_STAGE_INTERSECTION_BIT_KHR: return "rint";
+        case VK_SHADER_STAGE_CALLABLE_BIT_KHR: return "rcall";
+        default: throw std::runtime_error("glslang can't compile for stage " + std::to_string(stage));
+    }
+}
+
+/// Empty if it's missing or isn't SPIR-V
+static SPIRVModule read_spirv(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return {};
+    size_t size = file.tellg();
+    SPIRVModule module(size / 4);
+    file.seekg(0);
+    if (size % 4 != 0 || module.empty() || !file.read(reinterpret_cast<char*>(module.data()), size) || module[0] != 0x07230203)
+        return {};
+    return module;
+}
+
+ShaderModule ShaderModule::from_source(imr::Device& device, const Source& source) noexcept(false) {
+    auto compiler = source.language == Source::C ? find_compiler("IMR_VCC", { "vcc" }) : find_compiler("IMR_GLSLANG", { "glslang", "glslangValidator" });
+
+    std::vector<uint8_t> key;
+    auto add_string = [&](const std::string& string) { add_to_key(key, std::vector<uint8_t>(string.begin(), string.end())); };
+    add_to_key(key, compiled_source_version);
+    add_to_key(key, source.language);
+    add_to_key(key, source.stage);
+    // a different compiler, or an update, might well produce different code
+    std::error_code error;
+    add_string(compiler.string());
+    add_to_key(key, std::filesystem::last_write_time(compiler, error).time_since_epoch().count());
+    add_to_key(key, source.compiler_args.size());
+    for (auto& arg : source.compiler_args)
+        add_string(arg);
+    add_string(source.code);
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash_bytes(key.data(), key.size())));
+    auto directory = cache_directory() / "spirv";
+    auto cached_path = directory / (std::string(name) + ".spv");
+
+    auto module = read_spirv(cached_path);
+    if (module.empty()) {
+        // other threads or processes might be compiling the same thing, they all get their own files
+        auto unique_name = std::string(name) + "-" + unique_file_suffix();
+        auto source_path = directory / (unique_name + (source.language == Source::C ? ".c" : ".glsl"));
+        auto output_path = directory / (unique_name + ".spv");
+        std::filesystem::create_directories(directory, error);
+        std::ofstream(source_path, std::ios::binary | std::ios::trunc) << source.code;
+
+        std::vector<std::string> args = { compiler.string() };
+        if (source.language == Source::GLSL)
+            args.insert(args.end(), { "-V", "-S", glslang_stage_name(source.stage) });
+        args.insert(args.end(), source.compiler_args.begin(), source.compiler_args.end());
+        args.insert(args.end(), { source_path.string(), "-o", output_path.string() });
+        bool compiled = run_process(args);
+
+        module = read_spirv(output_path);
+        std::filesystem::remove(output_path, error);
+        // the source stays around for a look at what went wrong
+        if (!compiled || module.empty())
+            throw std::runtime_error("Failed to compile " + source_path.string() + " with " + compiler.string());
+        std::filesystem::remove(source_path, error);
+        write_cache_file(cached_path, module.data(), module.size() * 4);
+    }
+
+    return ShaderModule(std::make_unique<Impl>(device, module, std::move(module)));
+}
+
+}
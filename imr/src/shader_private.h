@@ -6,7 +6,17 @@
 namespace imr {
 
 using SPIRVModule = std::vector<uint32_t>;
+/// SPIR-V files are looked up next to the executable
+std::filesystem::path spirv_module_path(const std::string& filename);
 SPIRVModule load_spirv_module(const std::string& filename);
+/// The workgroup size of a compute entry point, taking specialization (local_size_x_id & co.) into account
+VkExtent3D reflect_local_size(const SPIRVModule&, const std::string& entry_point, const SpecializationConstants&);
+/// FNV-1a, stable across runs and machines
+uint64_t hash_bytes(const void* data, size_t size);
+/// The reflection cache on disk is keyed by it
+uint64_t hash_spirv(const SPIRVModule&);
+/// Independent of hash_spirv(), so the reflection cache can tell colliding modules apart
+uint64_t check_hash_spirv(const SPIRVModule&);
 
 /// Generates set layouts and pipeline layouts from the SPIR-V module by parsing it as a shady module and using the IR inspection API to find bindings and such
 struct ReflectedLayout {
@@ -18,6 +28,9 @@ struct ReflectedLayout {
     ReflectedLayout(SPIRVModule& spirv_module, VkShaderStageFlags stage);
     ReflectedLayout(ReflectedLayout& a, ReflectedLayout& b);
 
+    /// Copy with every binding and push constant range used by `stage` (only)
+    ReflectedLayout with_stage(VkShaderStageFlags stage) const;
+
     const VkDescriptorSetLayoutBinding* find_binding(uint32_t set, uint32_t binding) const {
         auto it = set_bindings.find(set);
         if (it == set_bindings.end()) return nullptr;
@@ -28,23 +41,57 @@ struct ReflectedLayout {
     }
 };
 
-/// Turns the ReflectedLayout into the VkDescriptorSetLayout s and VkPipelineLayout
+/// Shared by every PipelineLayout that has identical bindings in that set
+struct DescriptorSetLayout {
+    imr::Device& device;
+    VkDescriptorSetLayout set_layout;
+
+    DescriptorSetLayout(imr::Device& device, std::vector<VkDescriptorSetLayoutBinding>& bindings);
+    DescriptorSetLayout(const DescriptorSetLayout&) = delete;
+    ~DescriptorSetLayout();
+};
+
+/// The VkDescriptorSetLayout s and VkPipelineLayout for a ReflectedLayout, get them from get_pipeline_layout()
 struct PipelineLayout {
     imr::Device& device;
 
+    std::vector<std::shared_ptr<DescriptorSetLayout>> shared_set_layouts;
     std::vector<VkDescriptorSetLayout> set_layouts;
     VkPipelineLayout pipeline_layout;
 
-    PipelineLayout(imr::Device& device, ReflectedLayout& reflected_layout);
+    PipelineLayout(imr::Device& device, std::vector<std::shared_ptr<DescriptorSetLayout>>&& set_layouts, std::vector<VkPushConstantRange>& push_constants);
+    PipelineLayout(const PipelineLayout&) = delete;
     ~PipelineLayout();
 };
 
-struct ShaderModule::Impl {
+/// Pipelines with the same bindings and push constants share their layout, which keeps them compatible: descriptor sets stay bound when switching between them
+std::shared_ptr<PipelineLayout> get_pipeline_layout(imr::Device& device, ReflectedLayout& reflected_layout);
+
+/// The VkShaderModule for some SPIR-V, shared by all the ShaderModules loading identical code
+struct ShaderModuleHandle {
     imr::Device& device;
+    uint64_t hash;
     SPIRVModule spirv_module;
     VkShaderModule vk_shader_module;
 
-    Impl(imr::Device& device, SPIRVModule&& spirv_module) noexcept(false);
+    ShaderModuleHandle(imr::Device& device, uint64_t hash, SPIRVModule&& spirv_module) noexcept(false);
+    ShaderModuleHandle(const ShaderModuleHandle&) = delete;
+    ~ShaderModuleHandle();
+};
+
+/// Looks the module up in the device's cache before creating it. `spirv` is only copied if a new module is needed, and not even then if `storage` holds it.
+std::shared_ptr<ShaderModuleHandle> get_shader_module(imr::Device& device, std::span<const uint32_t> spirv, SPIRVModule&& storage = {});
+/// The SPIR-V given to register_spirv() under that name, if any
+std::optional<std::span<const uint32_t>> find_registered_spirv(const std::string& filename);
+/// Parses the module only if neither the in-memory nor the on-disk cache knows it yet, the result has no stage flags set
+std::shared_ptr<const ReflectedLayout> reflect_shader_module(ShaderModuleHandle&);
+
+struct ShaderModule::Impl {
+    imr::Device& device;
+    std::shared_ptr<ShaderModuleHandle> handle;
+
+    Impl(imr::Device& device, std::span<const uint32_t> spirv, SPIRVModule&& storage = {}) noexcept(false);
+    Impl(imr::Device& device, std::shared_ptr<ShaderModuleHandle> handle) : device(device), handle(std::move(handle)) {}
 
     Impl(const Impl&) = delete;
     Impl(Impl&&) = default;
@@ -57,29 +104,101 @@ struct ShaderEntryPoint::Impl {
     VkShaderStageFlagBits stage;
     std::string name;
     std::unique_ptr<ReflectedLayout> reflected;
+    SpecializationConstants specialization;
+    VkSpecializationInfo specialization_info;
 
-    Impl(ShaderModule& module, VkShaderStageFlagBits stage, const std::string& entrypoint_name);
+    Impl(ShaderModule& module, VkShaderStageFlagBits stage, const std::string& entrypoint_name, SpecializationConstants&& specialization);
+
+    /// For VkPipelineShaderStageCreateInfo, null when there's nothing to specialize
+    const VkSpecializationInfo* vk_specialization_info() const { return specialization.empty() ? nullptr : &specialization_info; }
     ~Impl();
 };
 
+/// The descriptor sets ComputePipeline::launch() has written, keyed by the set and the resources in it. They come from pools of the cache's own.
+/// A set is never written again once it's in use. It leaves the cache when one of its resources is destroyed or when it's the least recently used one
+/// beyond max_sets, and is freed once every recording that launched with it has been submitted and has completed.
+struct LaunchCache {
+    static constexpr size_t max_sets = 256;
+    /// Launches tend to come back to the same few resources, so one pool usually does
+    static constexpr uint32_t sets_per_pool = 64;
+
+    struct Entry {
+        VkDescriptorSet set;
+        VkDescriptorPool pool;
+        /// The handles in it, see forget_launch_binding()
+        std::vector<uint64_t> handles;
+        /// Recordings that launched with it and might still be running
+        std::vector<std::shared_ptr<RecordingTicket>> recordings;
+        std::list<const std::vector<uint8_t>*>::iterator lru_position;
+    };
+
+    Device& device;
+    PipelineLayout& layout;
+    /// A copy, the entry point isn't necessarily kept alive by the pipeline
+    ReflectedLayout reflected;
+    /// End of the reflected push constant ranges and where the first one starts, both 0 without push constants
+    uint32_t push_constants_begin = 0;
+    uint32_t push_constants_end = 0;
+
+    std::mutex mutex;
+    /// Newest last, earlier ones only have room where sets were freed
+    std::vector<VkDescriptorPool> pools;
+    std::map<std::vector<uint8_t>, Entry> sets;
+    /// Keys of `sets`, least recently used first
+    std::list<const std::vector<uint8_t>*> lru;
+    /// Out of the cache, but maybe still in use
+    std::vector<Entry> retired;
+
+    LaunchCache(Device&, PipelineLayout&, const ReflectedLayout&);
+    LaunchCache(const LaunchCache&) = delete;
+    ~LaunchCache();
+
+    /// `cmdbuf` is where the set gets bound, it's kept until that recording is done
+    VkDescriptorSet get(VkCommandBuffer cmdbuf, uint32_t set, const std::vector<const LaunchBinding*>& bindings);
+    void forget(uint64_t handle);
+
+private:
+    VkDescriptorPool allocate(uint32_t set, VkDescriptorSet&);
+    /// Drops the recordings that have completed, true once there are none left
+    bool done(std::vector<std::shared_ptr<RecordingTicket>>& recordings);
+    void retire(std::map<std::vector<uint8_t>, Entry>::iterator);
+    void free_retired();
+};
+
 struct ComputePipeline::Impl {
     Device& device;
-    std::unique_ptr<PipelineLayout> layout;
+    std::shared_ptr<PipelineLayout> layout;
     VkPipeline pipeline;
 
     std::unique_ptr<ShaderModule> module;
     std::unique_ptr<ShaderEntryPoint> entry_point;
 
-    Impl(imr::Device& device, std::unique_ptr<ShaderModule>&& module, std::unique_ptr<ShaderEntryPoint>&& ep);
-    Impl(imr::Device& device, ShaderEntryPoint& entry_point);
+    uint32_t subgroup_size;
+    VkExtent3D local_size;
+
+    std::unique_ptr<LaunchCache> launch_cache;
+
+    /// `module` may be null if the entry point's module is kept alive elsewhere
+    Impl(imr::Device& device, std::unique_ptr<ShaderModule>&& module, std::unique_ptr<ShaderEntryPoint>&& ep, const SubgroupSizeControl& subgroup_size_control = {});
+    Impl(imr::Device& device, ShaderEntryPoint& entry_point, const SubgroupSizeControl& subgroup_size_control = {});
     ~Impl();
 };
 
+struct ComputePipelineVariants::Impl {
+    Device& device;
+    std::unique_ptr<ShaderModule> module;
+    std::string entrypoint_name;
+
+    std::mutex mutex;
+    /// Keyed by SpecializationConstants::key()
+    std::map<std::vector<uint8_t>, std::unique_ptr<ComputePipeline>> variants;
+};
+
 struct RayTracingPipeline::Impl {
     Device& device;
     VkPipeline pipeline = VK_NULL_HANDLE;
 
-    std::unique_ptr<PipelineLayout> layout;
+    std::shared_ptr<PipelineLayout> layout;
     ReflectedLayout final_layout;
 
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingPipelineProperties {
@@ -110,15 +229,50 @@ struct RayTracingPipeline::Impl {
     ~Impl();
 };
 
+/// One of the four parts of a graphics pipeline (VK_EXT_graphics_pipeline_library), shared by all the pipelines that have it in common
+struct GraphicsPipelineLibrary {
+    Device& device;
+    VkPipeline pipeline;
+    /// Keeps the layout, and therefore its handle (part of the keys), alive
+    std::shared_ptr<PipelineLayout> layout;
+    /// Same for the shaders
+    std::vector<std::shared_ptr<ShaderModuleHandle>> modules;
+
+    ~GraphicsPipelineLibrary();
+};
+
+/// Building blocks for pipeline keys: the state that matters goes in byte for byte, pointers are followed.
+/// Only use the template on structs without padding or pointers.
+template<typename T>
+void add_to_key(std::vector<uint8_t>& key, const T& value) {
+    auto bytes = reinterpret_cast<const uint8_t*>(&value);
+    key.insert(key.end(), bytes, bytes + sizeof(T));
+}
+void add_to_key(std::vector<uint8_t>& key, const std::vector<uint8_t>& value);
+/// Shaders are identified by their deduplicated ShaderModuleHandle, which stands for the exact SPIR-V.
+/// The handle is added to `modules`: whoever keeps the key has to keep that too, or the address could be reused for other code.
+void add_stage_to_key(std::vector<uint8_t>& key, ShaderEntryPoint& stage, std::vector<std::shared_ptr<ShaderModuleHandle>>& modules);
+/// Extension structs aren't part of the keys, so state with a pNext chain can't be keyed. Throws if there is one.
+void reject_pnext_in_key(const void* pNext, const char* state);
+void add_vertex_input_state_to_key(std::vector<uint8_t>& key, const VkPipelineVertexInputStateCreateInfo*, const VkPipelineInputAssemblyStateCreateInfo*);
+void add_pre_rasterization_state_to_key(std::vector<uint8_t>& key, const VkPipelineTessellationStateCreateInfo*, const VkPipelineViewportStateCreateInfo*, const VkPipelineRasterizationStateCreateInfo*);
+void add_multisample_state_to_key(std::vector<uint8_t>& key, const VkPipelineMultisampleStateCreateInfo*);
+void add_depth_stencil_state_to_key(std::vector<uint8_t>& key, const VkPipelineDepthStencilStateCreateInfo*);
+
 struct GraphicsPipeline::Impl {
     Impl(Device& device, std::vector<ShaderEntryPoint*>&& stages, RenderTargetsState, StateBuilder);
 
     ~Impl();
 
+    /// Builds (or reuses) the four libraries described by `monolithic` and links them, without link-time optimization
+    static VkPipeline link_pipeline_libraries(Device&, std::shared_ptr<PipelineLayout>&, std::vector<ShaderEntryPoint*>& stages, const VkGraphicsPipelineCreateInfo& monolithic, const VkPipelineRenderingCreateInfo& rendering, std::vector<std::shared_ptr<GraphicsPipelineLibrary>>& libraries);
+
     Device& device_;
-    std::unique_ptr<PipelineLayout> layout;
+    std::shared_ptr<PipelineLayout> layout;
     ReflectedLayout final_layout;
     VkPipeline pipeline;
+    /// Only used with VK_EXT_graphics_pipeline_library, keeps the libraries alive so other pipelines can reuse them
+    std::vector<std::shared_ptr<GraphicsPipelineLibrary>> libraries;
 };
 
 }
@@ -0,0 +1,104 @@
+#include "shader_private.h"
+
+namespace imr {
+
+template<typename Pipeline>
+struct SharedPipelineEntry {
+    /// Compared on every hit, so two keys with the same hash only means the second pipeline doesn't get shared
+    std::vector<uint8_t> key;
+    /// The shaders are in the key by handle, holding on to them keeps those addresses from going to other code
+    std::vector<std::shared_ptr<ShaderModuleHandle>> modules;
+    std::weak_ptr<Pipeline> pipeline;
+};
+
+struct PipelineCache::Impl {
+    Device& device;
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, SharedPipelineEntry<ComputePipeline>> compute;
+    std::unordered_map<uint64_t, SharedPipelineEntry<GraphicsPipeline>> graphics;
+    /// Entries of destroyed pipelines get swept every so many insertions
+    size_t insertions = 0;
+
+    template<typename Pipeline, typename Fn>
+    std::shared_ptr<Pipeline> lookup(std::unordered_map<uint64_t, SharedPipelineEntry<Pipeline>>& entries, std::vector<uint8_t>&& key, std::vector<std::shared_ptr<ShaderModuleHandle>>&& modules, Fn build);
+};
+
+template<typename Pipeline, typename Fn>
+std::shared_ptr<Pipeline> PipelineCache::Impl::lookup(std::unordered_map<uint64_t, SharedPipelineEntry<Pipeline>>& entries, std::vector<uint8_t>&& key, std::vector<std::shared_ptr<ShaderModuleHandle>>&& modules, Fn build) {
+    uint64_t hash = hash_bytes(key.data(), key.size());
+    {
+        std::lock_guard lock(mutex);
+        auto found = entries.find(hash);
+        if (found != entries.end() && found->second.key == key) {
+            if (auto existing = found->second.pipeline.lock())
+                return existing;
+        }
+    }
+
+    std::shared_ptr<Pipeline> pipeline = build();
+
+    std::lock_guard lock(mutex);
+    auto& entry = entries[hash];
+    if (auto existing = entry.pipeline.lock())
+        return entry.key == key ? existing : pipeline;
+    entry = { std::move(key), std::move(modules), pipeline };
+    if (++insertions % 64 == 0)
+        std::erase_if(entries, [](auto& entry) { return entry.second.pipeline.expired(); });
+    return pipeline;
+}
+
+PipelineCache::PipelineCache(Device& device) {
+    _impl = std::make_unique<Impl>(device);
+}
+
+std::shared_ptr<ComputePipeline> PipelineCache::compute(ShaderEntryPoint& entry_point) {
+    std::vector<uint8_t> key;
+    std::vector<std::shared_ptr<ShaderModuleHandle>> modules;
+    add_stage_to_key(key, entry_point, modules);
+
+    return _impl->lookup(_impl->compute, std::move(key), std::move(modules), [&]() {
+        // the pipeline gets its own entry point, on a module sharing the VkShaderModule, so the caller's can go away
+        auto& device = _impl->device;
+        auto module = std::make_unique<ShaderModule>(std::make_unique<ShaderModule::Impl>(device, entry_point.module()._impl->handle));
+        auto own_entry_point = std::make_unique<ShaderEntryPoint>(*module, entry_point.stage(), entry_point.name(), entry_point.specialization());
+        return std::make_shared<ComputePipeline>(std::make_unique<ComputePipeline::Impl>(device, std::move(module), std::move(own_entry_point)));
+    });
+}
+
+std::shared_ptr<GraphicsPipeline> PipelineCache::graphics(const std::vector<ShaderEntryPoint*>& stages, const GraphicsPipeline::RenderTargetsState& render_targets, const GraphicsPipeline::StateBuilder& state) {
+    std::vector<uint8_t> key;
+    std::vector<std::shared_ptr<ShaderModuleHandle>> modules;
+    add_to_key(key, stages.size());
+    for (auto stage : stages)
+        add_stage_to_key(key, *stage, modules);
+
+    add_to_key(key, render_targets.color.size());
+    for (auto& color : render_targets.color) {
+        add_to_key(key, color.format);
+        add_to_key(key, color.blending);
+    }
+    add_to_key(key, render_targets.depth ? render_targets.depth->format : VK_FORMAT_UNDEFINED);
+    reject_pnext_in_key(render_targets.all_targets_blend_state.pNext, "color blend");
+    add_to_key(key, render_targets.all_targets_blend_state.logicOpEnable);
+    add_to_key(key, render_targets.all_targets_blend_state.logicOp);
+    add_to_key(key, render_targets.all_targets_blend_state.blendConstants);
+
+    auto ptr = [](auto& optional) { return optional ? &*optional : nullptr; };
+    add_vertex_input_state_to_key(key, ptr(state.vertexInputState), ptr(state.inputAssemblyState));
+    add_pre_rasterization_state_to_key(key, ptr(state.tessellationState), ptr(state.viewportState), ptr(state.rasterizationState));
+    add_multisample_state_to_key(key, ptr(state.multisampleState));
+    add_depth_stencil_state_to_key(key, ptr(state.depthStencilState));
+    add_to_key(key, state.dynamicStates.size());
+    for (auto dynamic_state : state.dynamicStates)
+        add_to_key(key, dynamic_state);
+    add_to_key(key, state.fastLink);
+
+    return _impl->lookup(_impl->graphics, std::move(key), std::move(modules), [&]() {
+        return std::make_shared<GraphicsPipeline>(_impl->device, std::vector<ShaderEntryPoint*>(stages), render_targets, state);
+    });
+}
+
+PipelineCache::~PipelineCache() = default;
+
+}
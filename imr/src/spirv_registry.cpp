@@ -0,0 +1,112 @@
+#include "shader_private.h"
+
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace imr {
+
+/// The layout written by tools/spirv_pack.cpp, all little-endian uint32s:
+/// the header, then `count` entries, then the names and the (4-byte aligned) modules they point to, offsets are from the start of the file
+static constexpr uint32_t spirv_archive_magic = 0x41524d49; // "IMRA"
+static constexpr uint32_t spirv_archive_version = 1;
+
+struct SPIRVArchiveEntry {
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t spirv_offset;
+    uint32_t spirv_words;
+};
+
+struct SPIRVRegistry {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::span<const uint32_t>> modules;
+};
+
+/// Embedded modules register themselves during static initialization, so this can't be a plain global
+static SPIRVRegistry& registry() {
+    static SPIRVRegistry registry;
+    return registry;
+}
+
+void register_spirv(std::string filename, std::span<const uint32_t> spirv) {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    r.modules[std::move(filename)] = spirv;
+}
+
+std::optional<std::span<const uint32_t>> find_registered_spirv(const std::string& filename) {
+    auto& r = registry();
+    std::lock_guard lock(r.mutex);
+    auto found = r.modules.find(filename);
+    if (found == r.modules.end())
+        return std::nullopt;
+    return found->second;
+}
+
+/// Never unmapped, the registered spans point into it
+static std::span<const uint8_t> map_file(const std::filesystem::path& path) {
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return {};
+    struct stat st;
+    void* mapped = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return {};
+    return { static_cast<const uint8_t*>(mapped), static_cast<size_t>(st.st_size) };
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return {};
+    size_t size = file.tellg();
+    // uint32_t storage keeps the modules aligned
+    auto contents = new uint32_t[(size + 3) / 4];
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(contents), size))
+        return {};
+    return { reinterpret_cast<const uint8_t*>(contents), size };
+#endif
+}
+
+void mount_spirv_archive(const std::string& filename) {
+    auto bytes = map_file(spirv_module_path(filename));
+    auto word = [&](size_t offset) {
+        if (offset + 4 > bytes.size())
+            throw std::runtime_error("Truncated SPIR-V archive " + filename);
+        uint32_t value;
+        memcpy(&value, bytes.data() + offset, 4);
+        return value;
+    };
+
+    if (bytes.empty())
+        throw std::runtime_error("Failed to map " + filename);
+    if (word(0) != spirv_archive_magic || word(4) != spirv_archive_version)
+        throw std::runtime_error(filename + " is not a SPIR-V archive, or was written by a different version of imr");
+    uint32_t count = word(8);
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t entry_offset = 12 + i * sizeof(SPIRVArchiveEntry);
+        SPIRVArchiveEntry entry = {
+            .name_offset = word(entry_offset),
+            .name_size = word(entry_offset + 4),
+            .spirv_offset = word(entry_offset + 8),
+            .spirv_words = word(entry_offset + 12),
+        };
+        if (static_cast<size_t>(entry.name_offset) + entry.name_size > bytes.size() || entry.spirv_offset % 4 != 0 || static_cast<size_t>(entry.spirv_offset) + entry.spirv_words * size_t(4) > bytes.size())
+            throw std::runtime_error("Damaged SPIR-V archive " + filename);
+        std::string name(reinterpret_cast<const char*>(bytes.data() + entry.name_offset), entry.name_size);
+        register_spirv(std::move(name), { reinterpret_cast<const uint32_t*>(bytes.data() + entry.spirv_offset), entry.spirv_words });
+    }
+}
+
+}
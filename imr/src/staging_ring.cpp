@@ -0,0 +1,67 @@
+#include "imr_private.h"
+
+namespace imr {
+
+StagingRing::StagingRing(Device& device, uint64_t size) : device(device), size(size) {
+    VkBufferCreateInfo buffer_ci = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .flags = 0,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    // Dedicated memory: VMA maps the whole block for MAPPED_BIT, which must not be one Buffers get suballocated from
+    VmaAllocationCreateInfo vma_aci = {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+        .usage = VMA_MEMORY_USAGE_UNKNOWN,
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    };
+    VmaAllocationInfo allocation_info;
+    CHECK_VK_THROW(vmaCreateBuffer(device._impl->allocator, &buffer_ci, &vma_aci, &buffer, &allocation, &allocation_info));
+    mapped = reinterpret_cast<uint8_t*>(allocation_info.pMappedData);
+}
+
+std::optional<StagingRing::Allocation> StagingRing::allocate(uint64_t bytes, uint64_t alignment) {
+    std::lock_guard lock(mutex);
+    if (bytes > size)
+        return std::nullopt;
+
+    uint64_t begin = (head + alignment - 1) & ~(alignment - 1);
+    // Allocations have to be contiguous in the buffer, so if we'd straddle the end we skip ahead to the start again
+    if (begin % size + bytes > size)
+        begin = (begin / size + 1) * size;
+    uint64_t end = begin + bytes;
+
+    uint64_t tail = in_flight.empty() ? head : in_flight.front().start;
+    if (end - tail > size)
+        return std::nullopt;
+
+    in_flight.push_back({ head, end, false });
+    head = end;
+
+    return Allocation {
+        .offset = begin % size,
+        .mapped = mapped + begin % size,
+        .end = end,
+    };
+}
+
+void StagingRing::release(const Allocation& allocation) {
+    std::lock_guard lock(mutex);
+    for (auto& range : in_flight) {
+        if (range.end == allocation.end) {
+            range.released = true;
+            break;
+        }
+    }
+
+    // Space can only be reclaimed in order, frames don't necessarily retire in the order they were recorded in
+    while (!in_flight.empty() && in_flight.front().released)
+        in_flight.pop_front();
+}
+
+StagingRing::~StagingRing() {
+    vmaDestroyBuffer(device._impl->allocator, buffer, allocation);
+}
+
+}
@@ -36,19 +36,53 @@ SwapchainSlot::SwapchainSlot(Swapchain& s) : swapchain(s) {
         .objectHandle = reinterpret_cast<uint64_t>(copy_done),
         .pObjectName = "SwapchainSlot::present_queued"
     }));
+
+    command_pool = create_command_pool(device, device.main_queue_idx);
+    command_buffers.resize(preallocated_command_buffers);
+    CHECK_VK_THROW(vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = command_pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = static_cast<uint32_t>(command_buffers.size()),
+    }), command_buffers.data()));
+}
+
+VkCommandBuffer SwapchainSlot::next_command_buffer() {
+    if (used_command_buffers == command_buffers.size()) {
+        // more than we anticipated, keep the extra one around for the next frames
+        auto& device = swapchain._impl->device;
+        VkCommandBuffer cmdbuf;
+        CHECK_VK_THROW(vkAllocateCommandBuffers(device.device, tmpPtr<VkCommandBufferAllocateInfo>({
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = command_pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        }), &cmdbuf));
+        command_buffers.push_back(cmdbuf);
+    }
+    return command_buffers[used_command_buffers++];
+}
+
+void SwapchainSlot::recycle_command_buffers() {
+    if (used_command_buffers == 0)
+        return;
+    auto& device = swapchain._impl->device;
+    CHECK_VK_THROW(vkResetCommandPool(device.device, command_pool, 0));
+    used_command_buffers = 0;
 }
 
 SwapchainSlot::~SwapchainSlot() {
     auto& device = swapchain._impl->device;
+    // the frame recycles our command buffers when it goes away
+    frame.reset();
     if (wait_for_previous_present) {
         CHECK_VK_THROW(vkWaitForFences(device.device, 1, &wait_for_previous_present, true, UINT64_MAX));
-        vkDestroyFence(device.device, wait_for_previous_present, nullptr);
-        wait_for_previous_present = nullptr;
+        swapchain._impl->recycle_fence(wait_for_previous_present);
+        wait_for_previous_present = VK_NULL_HANDLE;
     }
     vkDestroySemaphore(device.device, copy_done, nullptr);
     vkDestroySemaphore(device.device, present_semaphore, nullptr);
-    if (wait_for_previous_present)
-        vkDestroyFence(device.device, wait_for_previous_present, nullptr);
+    vkDestroyCommandPool(device.device, command_pool, nullptr);
 }
 
 Swapchain::Swapchain(Device& device, GLFWwindow* window) {
@@ -58,11 +92,49 @@ Swapchain::Swapchain(Device& device, GLFWwindow* window) {
     _impl->build_swapchain();
 }
 
+Swapchain::Swapchain(Device& device, OffscreenTarget target) {
+    _impl = std::make_unique<Swapchain::Impl>(*this, device, target);
+    _impl->build_swapchain();
+}
+
 Swapchain::Impl::Impl(Swapchain& parent, Device& device, GLFWwindow* window) : parent(parent), device(device), window(window) {
     CHECK_VK_THROW(glfwCreateWindowSurface(device.context.instance, window, nullptr, &surface));
 }
 
+Swapchain::Impl::Impl(Swapchain& parent, Device& device, OffscreenTarget target) : parent(parent), device(device), offscreen(target) {
+    assert(target.frames_in_flight > 0);
+}
+
+VkExtent2D Swapchain::Impl::extent() const {
+    if (offscreen)
+        return offscreen->size;
+    return swapchain.extent;
+}
+
+VkFormat Swapchain::Impl::format() const {
+    if (offscreen)
+        return offscreen->format;
+    return swapchain.image_format;
+}
+
+VkImageLayout Swapchain::Impl::final_layout() const {
+    // PRESENT_SRC_KHR is only valid for swapchain images
+    if (offscreen)
+        return VK_IMAGE_LAYOUT_GENERAL;
+    return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
 void Swapchain::Impl::build_swapchain() {
+    if (offscreen) {
+        for (uint32_t i = 0; i < offscreen->frames_in_flight; i++) {
+            auto& slot = *slots.emplace_back(std::make_unique<SwapchainSlot>(parent));
+            slot.offscreen_image = std::make_unique<Image>(device, VK_IMAGE_TYPE_2D, VkExtent3D { offscreen->size.width, offscreen->size.height, 1 }, offscreen->format, static_cast<VkImageUsageFlagBits>(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT));
+            slot.image = slot.offscreen_image->handle();
+            slot.image_index = i;
+        }
+        return;
+    }
+
     uint32_t surface_formats_count;
     CHECK_VK_THROW(vkGetPhysicalDeviceSurfaceFormatsKHR(device.physical_device, surface, &surface_formats_count, nullptr));
 
@@ -109,42 +181,86 @@ void Swapchain::Impl::build_swapchain() {
 
 void Swapchain::Impl::destroy_swapchain() {
     slots.clear();
-    vkb::destroy_swapchain(swapchain);
+    if (!offscreen)
+        vkb::destroy_swapchain(swapchain);
 }
 
 Swapchain::Impl::~Impl() {
-    vkDestroySurfaceKHR(device.context.dispatch.instance, surface, nullptr);
-}
-
-Device& Swapchain::device() const { return _impl->device; }
-
-VkFormat Swapchain::format() const {
-    return _impl->swapchain.image_format;
+    for (auto semaphore : spare_semaphores)
+        vkDestroySemaphore(device.device, semaphore, nullptr);
+    for (auto fence : spare_fences)
+        vkDestroyFence(device.device, fence, nullptr);
+    if (surface)
+        vkDestroySurfaceKHR(device.context.dispatch.instance, surface, nullptr);
 }
 
-/// Acquires the next image
-std::optional<std::tuple<SwapchainSlot&, VkSemaphore>> nextSwapchainSlot(Swapchain::Impl* _impl) {
-    auto& device = _impl->device;
-    auto& vk = device.dispatch;
-
-    uint32_t image_index;
+VkSemaphore Swapchain::Impl::get_semaphore() {
+    if (!spare_semaphores.empty()) {
+        auto semaphore = spare_semaphores.back();
+        spare_semaphores.pop_back();
+        return semaphore;
+    }
 
-    VkSemaphore image_acquired_semaphore;
+    VkSemaphore semaphore;
     CHECK_VK_THROW(vkCreateSemaphore(device.device, tmpPtr<VkSemaphoreCreateInfo>({
         .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-    }), nullptr, &image_acquired_semaphore));
+    }), nullptr, &semaphore));
 
-    vk.setDebugUtilsObjectNameEXT(tmpPtr<VkDebugUtilsObjectNameInfoEXT>({
+    device.dispatch.setDebugUtilsObjectNameEXT(tmpPtr<VkDebugUtilsObjectNameInfoEXT>({
         .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
         .objectType = VK_OBJECT_TYPE_SEMAPHORE,
-        .objectHandle = reinterpret_cast<uint64_t>(image_acquired_semaphore),
+        .objectHandle = reinterpret_cast<uint64_t>(semaphore),
         .pObjectName = "SwapchainSlot::image_acquired"
     }));
+    return semaphore;
+}
+
+void Swapchain::Impl::recycle_semaphore(VkSemaphore semaphore) {
+    spare_semaphores.push_back(semaphore);
+}
+
+VkFence Swapchain::Impl::get_fence() {
+    if (!spare_fences.empty()) {
+        auto fence = spare_fences.back();
+        spare_fences.pop_back();
+        return fence;
+    }
 
     VkFence fence;
     CHECK_VK_THROW(vkCreateFence(device.device, tmpPtr<VkFenceCreateInfo>({
         .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
     }), nullptr, &fence));
+    return fence;
+}
+
+void Swapchain::Impl::recycle_fence(VkFence fence) {
+    CHECK_VK_THROW(vkResetFences(device.device, 1, &fence));
+    spare_fences.push_back(fence);
+}
+
+Device& Swapchain::device() const { return _impl->device; }
+
+VkFormat Swapchain::format() const {
+    return _impl->format();
+}
+
+/// Acquires the next image
+std::optional<std::tuple<SwapchainSlot&, VkSemaphore>> nextSwapchainSlot(Swapchain::Impl* _impl) {
+    auto& device = _impl->device;
+    auto& vk = device.dispatch;
+
+    if (_impl->offscreen) {
+        // Nothing to acquire, we just go round the ring. Retiring the frame that used the slot last is all the waiting needed.
+        SwapchainSlot& slot = *_impl->slots[_impl->frame_counter % _impl->slots.size()];
+        slot.frame.reset();
+        VkSemaphore no_semaphore = VK_NULL_HANDLE;
+        return std::tie<SwapchainSlot&, VkSemaphore>(slot, no_semaphore);
+    }
+
+    uint32_t image_index;
+
+    VkSemaphore image_acquired_semaphore = _impl->get_semaphore();
+    VkFence fence = _impl->get_fence();
 
     VkResult acquire_result = device.dispatch.acquireNextImageKHR(_impl->swapchain, UINT64_MAX, image_acquired_semaphore, fence, &image_index);
     switch (acquire_result) {
@@ -152,8 +268,9 @@ std::optional<std::tuple<SwapchainSlot&, VkSemaphore>> nextSwapchainSlot(Swapcha
         case VK_SUBOPTIMAL_KHR: _impl->should_resize = true; break;
         case VK_ERROR_OUT_OF_DATE_KHR: {
             fprintf(stderr, "Acquire failed. We need to resize!\n");
-            vkDestroySemaphore(device.device, image_acquired_semaphore, nullptr);
-            vkDestroyFence(device.device, fence, nullptr);
+            // nothing got queued, they're still unsignalled
+            _impl->recycle_semaphore(image_acquired_semaphore);
+            _impl->recycle_fence(fence);
             return std::nullopt;
         }
         default:
@@ -175,7 +292,7 @@ std::optional<std::tuple<SwapchainSlot&, VkSemaphore>> nextSwapchainSlot(Swapcha
     // We could also set and wait on an acquire fence, but the validation layers are apparently not convinced this is sufficiently safe...
     if (prev_fence) {
         CHECK_VK_THROW(vkWaitForFences(device.device, 1, &prev_fence, true, UINT64_MAX));
-        vkDestroyFence(device.device, prev_fence, nullptr);
+        _impl->recycle_fence(prev_fence);
     }
     //printf("Waited for %llx\n", (uint64_t) slot.wait_for_previous_present);
 
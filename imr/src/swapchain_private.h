@@ -12,9 +12,17 @@ struct Swapchain::Impl {
     Device& device;
     GLFWwindow* window = nullptr;
     Impl(Swapchain& parent, Device&, GLFWwindow*);
+    Impl(Swapchain& parent, Device&, OffscreenTarget);
     ~Impl();
 
-    VkSurfaceKHR surface;
+    /// Set instead of `window` when rendering offscreen, there is no surface nor vkb::Swapchain then
+    std::optional<OffscreenTarget> offscreen;
+    VkExtent2D extent() const;
+    VkFormat format() const;
+    /// What renderFrameSimplified and the present helpers leave the image in
+    VkImageLayout final_layout() const;
+
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
     size_t frame_counter = 0;
 
     uint64_t last_present = 0;
@@ -25,6 +33,16 @@ struct Swapchain::Impl {
 
     void build_swapchain();
     void destroy_swapchain();
+
+    /// Synchronisation objects for acquiring images are recycled, so a steady-state frame doesn't create any
+    std::vector<VkSemaphore> spare_semaphores;
+    std::vector<VkFence> spare_fences;
+    VkSemaphore get_semaphore();
+    /// The semaphore must be unsignalled, with no pending wait on it
+    void recycle_semaphore(VkSemaphore);
+    VkFence get_fence();
+    /// The fence must be signalled or never have been submitted, it gets reset here
+    void recycle_fence(VkFence);
 };
 
 struct SwapchainSlot {
@@ -34,11 +52,23 @@ struct SwapchainSlot {
 
     VkImage image;
     uint32_t image_index;
+    /// Owns `image` for offscreen swapchains
+    std::unique_ptr<Image> offscreen_image;
 
     VkSemaphore copy_done;
     VkSemaphore present_semaphore;
     VkFence wait_for_previous_present = VK_NULL_HANDLE;
 
+    /// Primary command buffers for the frame in this slot, allocated once and reset all at once when the frame retires
+    static constexpr size_t preallocated_command_buffers = 2;
+    VkCommandPool command_pool;
+    std::vector<VkCommandBuffer> command_buffers;
+    size_t used_command_buffers = 0;
+
+    /// Only for the thread driving the swapchain, use Frame::allocateCommandBuffer() from others
+    VkCommandBuffer next_command_buffer();
+    void recycle_command_buffers();
+
     std::unique_ptr<Swapchain::Frame> frame = nullptr;
 
     ~SwapchainSlot();
@@ -55,12 +85,29 @@ struct Swapchain::Frame::Impl {
     Impl& operator=(Impl&&) = default;
     Impl(Device&, SwapchainSlot&);
 
-    std::vector<VkFence> cleanup_fences;
+    uint64_t cleanup_ticket = 0;
+    /// Pools lent to this frame by allocateCommandBuffer(), one per recording thread
+    std::vector<std::tuple<std::thread::id, VkCommandPool>> command_pools;
     std::vector<std::function<void(void)>> cleanup_queue;
 };
 
 std::optional<std::tuple<SwapchainSlot&, VkSemaphore>> nextSwapchainSlot(Swapchain::Impl* _impl);
 
+/// Offscreen frames have no acquire/present semaphores, this leaves out the null ones
+static inline std::vector<VkSemaphoreSubmitInfo> semaphore_submit_infos(std::initializer_list<VkSemaphore> semaphores) {
+    std::vector<VkSemaphoreSubmitInfo> infos;
+    for (auto semaphore : semaphores) {
+        if (semaphore == VK_NULL_HANDLE)
+            continue;
+        infos.push_back({
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = semaphore,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        });
+    }
+    return infos;
+}
+
 }
 
 #endif
@@ -0,0 +1,177 @@
+#include "shader_private.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace imr {
+
+/// Each candidate gets one warm-up dispatch, then the median of these many timed ones counts
+static constexpr int timed_dispatches = 5;
+
+struct WorkgroupSizeTuner::Impl {
+    Device& device;
+    ComputePipelineVariants variants;
+    std::array<uint32_t, 3> size_constant_ids;
+    /// Part of the keys, the tuned size belongs to the code rather than the file name
+    uint64_t spirv_hash;
+    std::string entrypoint_name;
+
+    Impl(Device& device, std::string&& spirv_filename, std::string&& entrypoint_name, std::array<uint32_t, 3> size_constant_ids)
+        : device(device), variants(device, std::move(spirv_filename), entrypoint_name), size_constant_ids(size_constant_ids), entrypoint_name(std::move(entrypoint_name)) {
+        spirv_hash = variants._impl->module->_impl->handle->hash;
+    }
+};
+
+/// One file per device and driver, since a new driver might well change the outcome. Lines of "<key> <x> <y> <z>".
+static std::filesystem::path tuned_sizes_path(Device& device) {
+    std::string filename = "workgroup_sizes-";
+    char byte_hex[3];
+    for (auto byte : device.physical_device.properties.pipelineCacheUUID) {
+        snprintf(byte_hex, sizeof(byte_hex), "%02x", byte);
+        filename += byte_hex;
+    }
+    return cache_directory() / (filename + ".txt");
+}
+
+/// Several tuners might update the file at once
+static std::mutex tuned_sizes_mutex;
+
+static std::map<uint64_t, VkExtent3D> load_tuned_sizes(const std::filesystem::path& path) {
+    std::map<uint64_t, VkExtent3D> sizes;
+    std::ifstream file(path);
+    uint64_t key;
+    VkExtent3D size;
+    while (file >> std::hex >> key >> std::dec >> size.width >> size.height >> size.depth)
+        sizes[key] = size;
+    return sizes;
+}
+
+static void save_tuned_sizes(const std::filesystem::path& path, const std::map<uint64_t, VkExtent3D>& sizes) {
+    std::stringstream contents;
+    for (auto& [key, size] : sizes)
+        contents << std::hex << key << std::dec << " " << size.width << " " << size.height << " " << size.depth << "\n";
+    auto text = contents.str();
+    write_cache_file(path, text.data(), text.size());
+}
+
+static std::vector<VkExtent3D> default_candidates(VkExtent3D extent) {
+    if (extent.height <= 1 && extent.depth <= 1)
+        return { { 32, 1, 1 }, { 64, 1, 1 }, { 128, 1, 1 }, { 256, 1, 1 }, { 512, 1, 1 }, { 1024, 1, 1 } };
+    return { { 8, 4, 1 }, { 8, 8, 1 }, { 16, 8, 1 }, { 16, 16, 1 }, { 32, 8, 1 }, { 32, 16, 1 }, { 32, 32, 1 } };
+}
+
+WorkgroupSizeTuner::WorkgroupSizeTuner(Device& device, std::string spirv_filename, std::string entrypoint_name, std::array<uint32_t, 3> size_constant_ids) {
+    _impl = std::make_unique<Impl>(device, std::move(spirv_filename), std::move(entrypoint_name), size_constant_ids);
+}
+
+ComputePipeline& WorkgroupSizeTuner::tune(VkExtent3D extent, const Bind& bind, std::vector<VkExtent3D> candidates, const SpecializationConstants& specialization) {
+    auto& device = _impl->device;
+    auto& limits = device.physical_device.properties.limits;
+    if (candidates.empty())
+        candidates = default_candidates(extent);
+    std::erase_if(candidates, [&](const VkExtent3D& size) {
+        return size.width * size.height * size.depth > limits.maxComputeWorkGroupInvocations
+            || size.width > limits.maxComputeWorkGroupSize[0] || size.height > limits.maxComputeWorkGroupSize[1] || size.depth > limits.maxComputeWorkGroupSize[2];
+    });
+    if (candidates.empty())
+        throw std::runtime_error("None of the workgroup sizes to try fit within the device's limits");
+
+    auto variant = [&](VkExtent3D size) -> ComputePipeline& {
+        auto with_size = specialization;
+        with_size.set<uint32_t>(_impl->size_constant_ids[0], size.width);
+        with_size.set<uint32_t>(_impl->size_constant_ids[1], size.height);
+        with_size.set<uint32_t>(_impl->size_constant_ids[2], size.depth);
+        return _impl->variants.get(with_size);
+    };
+
+    std::vector<uint8_t> key;
+    add_to_key(key, _impl->spirv_hash);
+    add_to_key(key, std::vector<uint8_t>(_impl->entrypoint_name.begin(), _impl->entrypoint_name.end()));
+    add_to_key(key, _impl->size_constant_ids);
+    add_to_key(key, specialization.key());
+    add_to_key(key, extent);
+    for (auto& candidate : candidates)
+        add_to_key(key, candidate);
+    uint64_t hash = hash_bytes(key.data(), key.size());
+
+    auto path = tuned_sizes_path(device);
+    {
+        std::lock_guard lock(tuned_sizes_mutex);
+        auto tuned = load_tuned_sizes(path);
+        if (auto found = tuned.find(hash); found != tuned.end())
+            return variant(found->second);
+    }
+
+    // what matters is whether the queue we time on can take timestamps, not the device-wide limit
+    uint32_t queue_families_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(device.physical_device, &queue_families_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_families_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device.physical_device, &queue_families_count, queue_families.data());
+    uint32_t valid_bits = queue_families[device.main_queue_idx].timestampValidBits;
+    if (valid_bits == 0 || candidates.size() == 1)
+        return variant(candidates.front());
+    // the remaining bits are undefined, and the counter may wrap between two timestamps
+    uint64_t valid_mask = valid_bits == 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    // build them all up front, so compiling doesn't get in the way of timing
+    std::vector<ComputePipeline*> pipelines;
+    for (auto& candidate : candidates)
+        pipelines.push_back(&variant(candidate));
+
+    uint32_t queries_count = candidates.size() * timed_dispatches * 2;
+    VkQueryPool query_pool;
+    CHECK_VK_THROW(vkCreateQueryPool(device.device, tmpPtr<VkQueryPoolCreateInfo>({
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = queries_count,
+    }), nullptr, &query_pool));
+
+    device.executeCommandsSync([&](VkCommandBuffer cmdbuf) {
+        vkCmdResetQueryPool(cmdbuf, query_pool, 0, queries_count);
+        uint32_t query = 0;
+        for (auto pipeline : pipelines) {
+            vkCmdBindPipeline(cmdbuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->pipeline());
+            bind(cmdbuf, *pipeline);
+            pipeline->dispatch_for_extent(cmdbuf, extent);
+            for (int i = 0; i < timed_dispatches; i++) {
+                // otherwise the timed dispatch may start while the previous one is still running
+                vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+                // bottom of pipe: the first one waits for the previous dispatch, the second one for this one
+                vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, query++);
+                pipeline->dispatch_for_extent(cmdbuf, extent);
+                vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, query++);
+            }
+        }
+    });
+
+    std::vector<uint64_t> timestamps(queries_count);
+    VkResult result = vkGetQueryPoolResults(device.device, query_pool, 0, queries_count, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    vkDestroyQueryPool(device.device, query_pool, nullptr);
+    CHECK_VK_THROW(result);
+
+    size_t best = 0;
+    uint64_t best_time = UINT64_MAX;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        std::vector<uint64_t> times;
+        for (int j = 0; j < timed_dispatches; j++) {
+            size_t query = (i * timed_dispatches + j) * 2;
+            times.push_back((timestamps[query + 1] - timestamps[query]) & valid_mask);
+        }
+        std::nth_element(times.begin(), times.begin() + timed_dispatches / 2, times.end());
+        if (times[timed_dispatches / 2] < best_time) {
+            best = i;
+            best_time = times[timed_dispatches / 2];
+        }
+    }
+
+    std::lock_guard lock(tuned_sizes_mutex);
+    auto tuned = load_tuned_sizes(path);
+    tuned[hash] = candidates[best];
+    save_tuned_sizes(path, tuned);
+    return *pipelines[best];
+}
+
+WorkgroupSizeTuner::~WorkgroupSizeTuner() = default;
+
+}
@@ -0,0 +1,107 @@
+// Packs SPIR-V modules for imr, either as C++ that registers them on startup or as an archive for imr::mount_spirv_archive()
+//   spirv_pack embed <output.cpp> <module.spv>...
+//   spirv_pack archive <output> <module.spv>...
+// Modules are registered under their filename, which is what imr::ShaderModule gets asked for.
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct Module {
+    std::string name;
+    std::vector<uint32_t> words;
+};
+
+static bool read_module(const char* path, Module& module) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    size_t size = file.tellg();
+    if (size % 4 != 0 || size == 0)
+        return false;
+    module.name = std::filesystem::path(path).filename().string();
+    module.words.resize(size / 4);
+    file.seekg(0);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(module.words.data()), size));
+}
+
+static bool write_embedded(const char* path, const std::vector<Module>& modules) {
+    std::ofstream file(path);
+    file << "// Generated by spirv_pack, do not edit\n#include \"imr/imr.h\"\n\nnamespace {\n\n";
+    for (size_t i = 0; i < modules.size(); i++) {
+        file << "alignas(4) constexpr uint32_t spirv_" << i << "[] = {";
+        char word[16];
+        for (size_t j = 0; j < modules[i].words.size(); j++) {
+            snprintf(word, sizeof(word), "0x%08x,", modules[i].words[j]);
+            file << (j % 8 == 0 ? "\n    " : " ") << word;
+        }
+        file << "\n};\n\n";
+    }
+    file << "const bool registered = []() {\n";
+    for (size_t i = 0; i < modules.size(); i++)
+        file << "    imr::register_spirv(\"" << modules[i].name << "\", spirv_" << i << ");\n";
+    file << "    return true;\n}();\n\n}\n";
+    return static_cast<bool>(file);
+}
+
+/// See spirv_registry.cpp for the layout
+static bool write_archive(const char* path, const std::vector<Module>& modules) {
+    std::vector<uint32_t> header = { 0x41524d49, 1, static_cast<uint32_t>(modules.size()) };
+    std::vector<uint8_t> names;
+    size_t names_offset = (header.size() + modules.size() * 4) * 4;
+    for (auto& module : modules) {
+        header.push_back(names_offset + names.size());
+        header.push_back(module.name.size());
+        names.insert(names.end(), module.name.begin(), module.name.end());
+        header.push_back(0);
+        header.push_back(module.words.size());
+    }
+    names.resize((names.size() + 3) & ~3);
+
+    size_t spirv_offset = names_offset + names.size();
+    for (size_t i = 0; i < modules.size(); i++) {
+        header[3 + i * 4 + 2] = spirv_offset;
+        spirv_offset += modules[i].words.size() * 4;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size() * 4);
+    file.write(reinterpret_cast<const char*>(names.data()), names.size());
+    for (auto& module : modules)
+        file.write(reinterpret_cast<const char*>(module.words.data()), module.words.size() * 4);
+    return static_cast<bool>(file);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s embed|archive <output> <module.spv>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Module> modules(argc - 3);
+    for (int i = 3; i < argc; i++) {
+        if (!read_module(argv[i], modules[i - 3])) {
+            fprintf(stderr, "Failed to read SPIR-V from %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::string mode = argv[1];
+    bool written;
+    if (mode == "embed")
+        written = write_embedded(argv[2], modules);
+    else if (mode == "archive")
+        written = write_archive(argv[2], modules);
+    else {
+        fprintf(stderr, "Unknown mode %s\n", mode.c_str());
+        return 1;
+    }
+    if (!written) {
+        fprintf(stderr, "Failed to write %s\n", argv[2]);
+        return 1;
+    }
+    return 0;
+}